@@ -0,0 +1,189 @@
+/*
+ *  buffer_pool.c - Size-class allocator for VA buffers
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "sysdeps.h"
+#include "buffer_pool.h"
+#include "utils.h"
+#include "debug.h"
+
+// Returns the size class index for the specified size, or -1 if too large
+static int
+get_class_index(unsigned int size)
+{
+    int shift = BUFFER_POOL_MIN_SHIFT;
+
+    if (size > (1U << BUFFER_POOL_MAX_SHIFT))
+        return -1;
+
+    if (size > (1U << BUFFER_POOL_MIN_SHIFT))
+        shift = 32 - __builtin_clz(size - 1);
+    return shift - BUFFER_POOL_MIN_SHIFT;
+}
+
+// Carves a new slab into free blocks of the specified size class
+static int
+refill_class(buffer_pool_t *pool, int class_index)
+{
+    buffer_pool_class_t * const cls = &pool->classes[class_index];
+    const unsigned int block_size = 1U << (class_index + BUFFER_POOL_MIN_SHIFT);
+    uint8_t *slab;
+    unsigned int i;
+
+    if (!realloc_buffer((void **)&pool->slabs, &pool->num_slabs_max,
+                        pool->num_slabs + 1, sizeof(*pool->slabs)))
+        return -1;
+
+    slab = malloc(BUFFER_POOL_SLAB_SIZE);
+    if (!slab)
+        return -1;
+    pool->slabs[pool->num_slabs++] = slab;
+
+    for (i = BUFFER_POOL_SLAB_SIZE / block_size; i-- > 0;) {
+        void **block = (void **)(slab + i * block_size);
+        *block = cls->free_list;
+        cls->free_list = block;
+        cls->num_free++;
+    }
+    return 0;
+}
+
+int
+buffer_pool_init(buffer_pool_t *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->mutex, NULL);
+    return 0;
+}
+
+void
+buffer_pool_destroy(buffer_pool_t *pool)
+{
+    unsigned int i;
+    int class_index;
+
+    /* Large blocks are owned individually, slab blocks by their slab */
+    for (class_index = BUFFER_POOL_SLAB_SHIFT - BUFFER_POOL_MIN_SHIFT + 1;
+         class_index < BUFFER_POOL_NUM_CLASSES; class_index++) {
+        void *block = pool->classes[class_index].free_list;
+        while (block) {
+            void *next = *(void **)block;
+            free(block);
+            block = next;
+        }
+    }
+
+    for (i = 0; i < pool->num_slabs; i++)
+        free(pool->slabs[i]);
+    free(pool->slabs);
+
+    pthread_mutex_destroy(&pool->mutex);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void *
+buffer_pool_alloc(buffer_pool_t *pool, unsigned int size, unsigned int *pcapacity)
+{
+    const int class_index = get_class_index(size);
+    buffer_pool_class_t *cls;
+    void *block = NULL;
+
+    stats_count_allocation();
+    if (class_index < 0) {
+        stats_mutex_lock(&pool->mutex);
+        pool->large_allocs++;
+        pthread_mutex_unlock(&pool->mutex);
+        *pcapacity = size;
+        return malloc(size);
+    }
+    *pcapacity = 1U << (class_index + BUFFER_POOL_MIN_SHIFT);
+
+    stats_mutex_lock(&pool->mutex);
+    cls = &pool->classes[class_index];
+    if (cls->free_list)
+        cls->hits++;
+    else {
+        cls->misses++;
+        if (class_index + BUFFER_POOL_MIN_SHIFT <= BUFFER_POOL_SLAB_SHIFT)
+            refill_class(pool, class_index);
+    }
+    if (cls->free_list) {
+        block = cls->free_list;
+        cls->free_list = *(void **)block;
+        cls->num_free--;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (!block && class_index + BUFFER_POOL_MIN_SHIFT > BUFFER_POOL_SLAB_SHIFT)
+        block = malloc(*pcapacity);
+    return block;
+}
+
+void
+buffer_pool_free(buffer_pool_t *pool, void *ptr, unsigned int capacity)
+{
+    const int class_index = get_class_index(capacity);
+    buffer_pool_class_t *cls;
+
+    if (!ptr)
+        return;
+
+    if (class_index < 0) {
+        free(ptr);
+        return;
+    }
+    ASSERT(capacity == 1U << (class_index + BUFFER_POOL_MIN_SHIFT));
+
+    stats_mutex_lock(&pool->mutex);
+    cls = &pool->classes[class_index];
+    if (class_index + BUFFER_POOL_MIN_SHIFT > BUFFER_POOL_SLAB_SHIFT &&
+        cls->num_free >= BUFFER_POOL_MAX_CACHED_BLOCKS) {
+        pthread_mutex_unlock(&pool->mutex);
+        free(ptr);
+        return;
+    }
+    *(void **)ptr = cls->free_list;
+    cls->free_list = ptr;
+    cls->num_free++;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void
+buffer_pool_dump_statistics(buffer_pool_t *pool, const char *name)
+{
+    int class_index;
+
+    stats_mutex_lock(&pool->mutex);
+    for (class_index = 0; class_index < BUFFER_POOL_NUM_CLASSES; class_index++) {
+        const buffer_pool_class_t * const cls = &pool->classes[class_index];
+        if (cls->hits == 0 && cls->misses == 0)
+            continue;
+        vdpau_information_message("%s: %7u bytes: %llu hits, %llu misses\n",
+                                  name,
+                                  1U << (class_index + BUFFER_POOL_MIN_SHIFT),
+                                  (unsigned long long)cls->hits,
+                                  (unsigned long long)cls->misses);
+    }
+    if (pool->large_allocs > 0)
+        vdpau_information_message("%s: %llu allocations over %u bytes\n",
+                                  name,
+                                  (unsigned long long)pool->large_allocs,
+                                  1U << BUFFER_POOL_MAX_SHIFT);
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,93 @@
+/*
+ *  buffer_pool.h - Size-class allocator for VA buffers
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <pthread.h>
+
+/* Size classes are powers of two, from 64 bytes up to 1 MB. Classes up
+   to 4 KB are carved out of 64 KB slabs, larger ones are allocated one
+   block at a time and a few of them are kept around once released */
+#define BUFFER_POOL_MIN_SHIFT           6
+#define BUFFER_POOL_SLAB_SHIFT          12
+#define BUFFER_POOL_MAX_SHIFT           20
+#define BUFFER_POOL_NUM_CLASSES         (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1)
+#define BUFFER_POOL_SLAB_SIZE           (64 * 1024)
+#define BUFFER_POOL_MAX_CACHED_BLOCKS   16
+
+typedef struct buffer_pool       buffer_pool_t;
+typedef struct buffer_pool_class buffer_pool_class_t;
+
+struct buffer_pool_class {
+    void               *free_list;
+    unsigned int        num_free;
+    uint64_t            hits;
+    uint64_t            misses;
+};
+
+struct buffer_pool {
+    pthread_mutex_t     mutex;
+    buffer_pool_class_t classes[BUFFER_POOL_NUM_CLASSES];
+    void              **slabs;
+    unsigned int        num_slabs;
+    unsigned int        num_slabs_max;
+    uint64_t            large_allocs;
+};
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+buffer_pool_init(buffer_pool_t *pool)
+    attribute_hidden;
+
+/*
+ * Releases all memory held by the pool, all blocks must have been freed
+ */
+void
+buffer_pool_destroy(buffer_pool_t *pool)
+    attribute_hidden;
+
+/*
+ * Allocates a block of at least size bytes
+ * The actual block capacity is returned in *pcapacity and must be
+ * passed back to buffer_pool_free()
+ * Returns NULL on error
+ */
+void *
+buffer_pool_alloc(buffer_pool_t *pool, unsigned int size, unsigned int *pcapacity)
+    attribute_hidden;
+
+/*
+ * Releases a block allocated with buffer_pool_alloc()
+ */
+void
+buffer_pool_free(buffer_pool_t *pool, void *ptr, unsigned int capacity)
+    attribute_hidden;
+
+/*
+ * Dumps hit and miss counters of each size class
+ */
+void
+buffer_pool_dump_statistics(buffer_pool_t *pool, const char *name)
+    attribute_hidden;
+
+#endif /* BUFFER_POOL_H */
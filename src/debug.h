@@ -21,6 +21,8 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include <pthread.h>
+
 void vdpau_error_message(const char *msg, ...)
      attribute_hidden;
 
@@ -37,6 +39,35 @@ void debug_message(const char *msg, ...)
 # define D(x)
 #endif
 
+// Returns TRUE if statistics are to be dumped on vaTerminate()
+int stats_enabled(void)
+    attribute_hidden;
+
+// Allocations and lock acquisitions made by the driver in this process,
+// counted when statistics are enabled
+typedef struct stats_counters stats_counters_t;
+struct stats_counters {
+    uint64_t    allocations;
+    uint64_t    locks;
+};
+
+extern stats_counters_t g_stats_counters attribute_hidden;
+
+// Counts an allocation made from a pool or from the heap
+static inline void stats_count_allocation(void)
+{
+    if (stats_enabled())
+        ATOMIC_ADD(&g_stats_counters.allocations, 1);
+}
+
+// Acquires a driver lock and counts it
+static inline void stats_mutex_lock(pthread_mutex_t *mutex)
+{
+    if (stats_enabled())
+        ATOMIC_ADD(&g_stats_counters.locks, 1);
+    pthread_mutex_lock(mutex);
+}
+
 // Returns TRUE if debug trace is enabled
 int trace_enabled(void)
     attribute_hidden;
@@ -21,6 +21,7 @@
 #include "sysdeps.h"
 #include <pthread.h>
 #include "object_heap.h"
+#include "debug.h"
 
 /* This code is:
  * Copyright (c) 2007 Intel Corporation. All Rights Reserved.
@@ -49,47 +50,123 @@
 #define LAST_FREE   -1
 #define ALLOCATED   -2
 
+/* Number of objects per bucket, expressed as a power of two */
+#define OBJECT_HEAP_BUCKET_SHIFT 4
+
+/* Returns the object at the specified index */
+static inline object_base_p
+object_heap_get(object_heap_p heap, void **bucket, int index)
+{
+    const int bucket_index = index >> heap->bucket_shift;
+    const int obj_index = index & ((1 << heap->bucket_shift) - 1);
+
+    return (object_base_p)(bucket[bucket_index] + obj_index * heap->object_size);
+}
+
+/* Returns the ID the object gets once recycled, with a new generation number */
+static inline int
+object_heap_get_next_id(object_heap_p heap, object_base_p obj)
+{
+    const int index = obj->id & OBJECT_HEAP_INDEX_MASK;
+    const int generation = (obj->id + (1 << OBJECT_HEAP_GENERATION_SHIFT)) &
+        OBJECT_HEAP_GENERATION_MASK;
+
+    return heap->id_offset | generation | index;
+}
+
 /*
- * Expands the heap
+ * Expands the heap so that it holds at least num_objects more objects.
+ * The heap grows geometrically and all new buckets are carved out of a
+ * single slab allocation.
  * Return 0 on success, -1 on error
  */
 static int
-object_heap_expand(object_heap_p heap)
+object_heap_expand(object_heap_p heap, int num_objects)
 {
-    int i;
-    void *new_heap_index;
-    int next_free;
-    int new_heap_size = heap->heap_size + heap->heap_increment;
-    int bucket_index = new_heap_size / heap->heap_increment - 1;
+    const int bucket_size = 1 << heap->bucket_shift;
+    const int max_heap_size = OBJECT_HEAP_MAX_SIZE;
+    int i, next_free, bucket_index, num_new_buckets, new_heap_size;
+    void *slab, **slabs;
+
+    if (num_objects > max_heap_size - heap->heap_size) {
+        return -1;
+    }
 
-    if (bucket_index >= heap->num_buckets) {
-        int new_num_buckets = heap->num_buckets + 8;
-        void **new_bucket;
+    new_heap_size = heap->heap_size + MAX(num_objects, heap->heap_size);
+    new_heap_size = MIN(new_heap_size, max_heap_size);
+    new_heap_size = (new_heap_size + bucket_size - 1) & -bucket_size;
+    num_new_buckets = (new_heap_size - heap->heap_size) >> heap->bucket_shift;
+    bucket_index = heap->heap_size >> heap->bucket_shift;
+
+    if (bucket_index + num_new_buckets > heap->num_buckets) {
+        int new_num_buckets = MAX(2 * heap->num_buckets, 8);
+        void **new_bucket, **retired_buckets;
+
+        new_num_buckets = MAX(new_num_buckets, bucket_index + num_new_buckets);
+
+        /* Readers scan the bucket table without the heap lock, so
+           the old table is retired rather than reallocated in place.
+           It is only released in object_heap_destroy() */
+        retired_buckets = realloc(heap->retired_buckets,
+                                  (heap->num_retired_buckets + 1) *
+                                  sizeof(void *));
+        if (NULL == retired_buckets) {
+            return -1;
+        }
+        heap->retired_buckets = retired_buckets;
 
-        new_bucket = realloc(heap->bucket, new_num_buckets * sizeof(void *));
+        new_bucket = malloc(new_num_buckets * sizeof(void *));
         if (NULL == new_bucket) {
             return -1;
         }
+        if (heap->bucket)
+            memcpy(new_bucket, heap->bucket, heap->num_buckets * sizeof(void *));
 
+        if (heap->bucket)
+            heap->retired_buckets[heap->num_retired_buckets++] = heap->bucket;
         heap->num_buckets = new_num_buckets;
-        heap->bucket = new_bucket;
+        ATOMIC_STORE(&heap->bucket, new_bucket);
+    }
+
+    if (new_heap_size > heap->num_occupancy_words * 64) {
+        const int num_words = (new_heap_size + 63) / 64;
+        uint64_t *occupancy;
+
+        occupancy = realloc(heap->occupancy, num_words * sizeof(uint64_t));
+        if (NULL == occupancy) {
+            return -1;
+        }
+        memset(occupancy + heap->num_occupancy_words, 0,
+               (num_words - heap->num_occupancy_words) * sizeof(uint64_t));
+        heap->occupancy = occupancy;
+        heap->num_occupancy_words = num_words;
+    }
+
+    slabs = realloc(heap->slabs, (heap->num_slabs + 1) * sizeof(void *));
+    if (NULL == slabs) {
+        return -1;
     }
+    heap->slabs = slabs;
 
-    new_heap_index = (void *) malloc(heap->heap_increment * heap->object_size);
-    if (NULL == new_heap_index) {
+    slab = malloc((new_heap_size - heap->heap_size) * heap->object_size);
+    if (NULL == slab) {
         return -1; /* Out of memory */
     }
+    heap->slabs[heap->num_slabs++] = slab;
+
+    for (i = 0; i < num_new_buckets; i++)
+        heap->bucket[bucket_index + i] =
+            slab + (i << heap->bucket_shift) * heap->object_size;
 
-    heap->bucket[bucket_index] = new_heap_index;
     next_free = heap->next_free;
     for (i = new_heap_size; i-- > heap->heap_size;) {
-        object_base_p obj = (object_base_p)(new_heap_index + (i - heap->heap_size) * heap->object_size);
+        object_base_p obj = object_heap_get(heap, heap->bucket, i);
         obj->id = i + heap->id_offset;
         obj->next_free = next_free;
         next_free = i;
     }
     heap->next_free = next_free;
-    heap->heap_size = new_heap_size;
+    ATOMIC_STORE(&heap->heap_size, new_heap_size);
     return 0; /* Success */
 }
 
@@ -103,11 +180,18 @@ object_heap_init(object_heap_p heap, int object_size, int id_offset)
     heap->object_size = object_size;
     heap->id_offset = id_offset & OBJECT_HEAP_OFFSET_MASK;
     heap->heap_size = 0;
-    heap->heap_increment = 16;
+    heap->bucket_shift = OBJECT_HEAP_BUCKET_SHIFT;
     heap->next_free = LAST_FREE;
     heap->num_buckets = 0;
     heap->bucket = NULL;
-    return object_heap_expand(heap);
+    heap->num_retired_buckets = 0;
+    heap->retired_buckets = NULL;
+    heap->num_slabs = 0;
+    heap->slabs = NULL;
+    heap->num_allocated = 0;
+    heap->num_occupancy_words = 0;
+    heap->occupancy = NULL;
+    return object_heap_expand(heap, 1);
 }
 
 /*
@@ -118,21 +202,19 @@ static int
 object_heap_allocate_unlocked(object_heap_p heap)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
 
     if (LAST_FREE == heap->next_free) {
-        if (-1 == object_heap_expand(heap)) {
-            return -1; /* Out of memory */
+        if (-1 == object_heap_expand(heap, 1)) {
+            return -1; /* Out of memory, or the heap is full */
         }
     }
     ASSERT(heap->next_free >= 0);
 
-    bucket_index = heap->next_free / heap->heap_increment;
-    obj_index = heap->next_free % heap->heap_increment;
-
-    obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
+    obj = object_heap_get(heap, heap->bucket, heap->next_free);
+    heap->occupancy[heap->next_free / 64] |= 1ULL << (heap->next_free % 64);
     heap->next_free = obj->next_free;
-    obj->next_free = ALLOCATED;
+    heap->num_allocated++;
+    ATOMIC_STORE(&obj->next_free, ALLOCATED);
     return obj->id;
 }
 
@@ -141,46 +223,124 @@ object_heap_allocate(object_heap_p heap)
 {
     int ret;
 
-    pthread_mutex_lock(&heap->mutex);
+    stats_mutex_lock(&heap->mutex);
     ret = object_heap_allocate_unlocked(heap);
     pthread_mutex_unlock(&heap->mutex);
     return ret;
 }
 
+/*
+ * Makes sure at least n objects can be allocated without expanding the heap
+ * Return 0 on success, -1 on error
+ */
+int
+object_heap_reserve(object_heap_p heap, int n)
+{
+    int ret = 0, num_free;
+
+    stats_mutex_lock(&heap->mutex);
+    num_free = heap->heap_size - heap->num_allocated;
+    if (num_free < n)
+        ret = object_heap_expand(heap, n - num_free);
+    pthread_mutex_unlock(&heap->mutex);
+    return ret;
+}
+
 /*
  * Lookup an object by object ID
  * Returns a pointer to the object on success, returns NULL on error
+ *
+ * This is wait-free: buckets are never moved or released while the
+ * heap is alive, and the bucket table is published after the objects
+ * it references are initialized. Only allocate and free serialize on
+ * the heap lock.
  */
-static object_base_p
-object_heap_lookup_unlocked(object_heap_p heap, int id)
+object_base_p
+object_heap_lookup(object_heap_p heap, int id)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
+    int index;
 
-    if ((id < heap->id_offset) || (id > (heap->heap_size + heap->id_offset))) {
+    if ((id & OBJECT_HEAP_OFFSET_MASK) != heap->id_offset) {
         return NULL;
     }
-    id &= OBJECT_HEAP_ID_MASK;
-    bucket_index = id / heap->heap_increment;
-    obj_index = id % heap->heap_increment;
-    obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
 
-    /* Check if the object has in fact been allocated */
-    if (obj->next_free != ALLOCATED) {
+    index = id & OBJECT_HEAP_INDEX_MASK;
+    if (index >= ATOMIC_LOAD(&heap->heap_size)) {
+        return NULL;
+    }
+    obj = object_heap_get(heap, ATOMIC_LOAD(&heap->bucket), index);
+
+    /* Check if the object has in fact been allocated, and that the
+       generation number matches, i.e. the ID is not stale */
+    if (ATOMIC_LOAD(&obj->next_free) != ALLOCATED ||
+        ATOMIC_LOAD(&obj->id) != id) {
         return NULL;
     }
     return obj;
 }
 
-object_base_p
-object_heap_lookup(object_heap_p heap, int id)
+/*
+ * Lookup an array of objects by object IDs, without taking the heap lock
+ * Return 0 if all objects were found, -1 otherwise
+ */
+int
+object_heap_lookup_many(
+    object_heap_p      heap,
+    const int         *ids,
+    int                num_ids,
+    object_base_p     *objs
+)
 {
     object_base_p obj;
+    void **bucket;
+    int i, index, heap_size, ret = 0;
+
+    heap_size = ATOMIC_LOAD(&heap->heap_size);
+    bucket = ATOMIC_LOAD(&heap->bucket);
+
+    for (i = 0; i < num_ids; i++) {
+        const int id = ids[i];
 
-    pthread_mutex_lock(&heap->mutex);
-    obj = object_heap_lookup_unlocked(heap, id);
+        objs[i] = NULL;
+        if ((id & OBJECT_HEAP_OFFSET_MASK) != heap->id_offset) {
+            ret = -1;
+            continue;
+        }
+
+        index = id & OBJECT_HEAP_INDEX_MASK;
+        if (index >= heap_size) {
+            ret = -1;
+            continue;
+        }
+        obj = object_heap_get(heap, bucket, index);
+
+        if (ATOMIC_LOAD(&obj->next_free) != ALLOCATED ||
+            ATOMIC_LOAD(&obj->id) != id) {
+            ret = -1;
+            continue;
+        }
+        objs[i] = obj;
+    }
+    return ret;
+}
+
+/*
+ * Locks the heap, e.g. to iterate over all objects at once
+ */
+void
+object_heap_lock(object_heap_p heap)
+{
+    stats_mutex_lock(&heap->mutex);
+}
+
+/*
+ * Unlocks the heap
+ */
+void
+object_heap_unlock(object_heap_p heap)
+{
     pthread_mutex_unlock(&heap->mutex);
-    return obj;
 }
 
 /*
@@ -194,30 +354,44 @@ object_heap_first(object_heap_p heap, object_heap_iterator *iter)
     return object_heap_next(heap, iter);
 }
 
+object_base_p
+object_heap_first_unlocked(object_heap_p heap, object_heap_iterator *iter)
+{
+    *iter = -1;
+    return object_heap_next_unlocked(heap, iter);
+}
+
 /*
  * Iterate over all objects in the heap.
  * Returns a pointer to the next object on the heap, returns NULL if heap is empty.
+ *
+ * Only allocated slots are visited, by scanning the occupancy bitmap.
  */
-static object_base_p
+object_base_p
 object_heap_next_unlocked(object_heap_p heap, object_heap_iterator *iter)
 {
-    object_base_p obj;
-    int bucket_index, obj_index;
     int i = *iter + 1;
+    int word_index = i / 64;
+    uint64_t word;
 
-    while (i < heap->heap_size) {
-        bucket_index = i / heap->heap_increment;
-        obj_index = i % heap->heap_increment;
+    if (i >= heap->heap_size) {
+        *iter = heap->heap_size;
+        return NULL;
+    }
 
-        obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
-        if (obj->next_free == ALLOCATED) {
-            *iter = i;
-            return obj;
+    word = heap->occupancy[word_index] & (~0ULL << (i % 64));
+    while (!word) {
+        if (++word_index >= heap->num_occupancy_words) {
+            *iter = heap->heap_size;
+            return NULL;
         }
-        i++;
+        word = heap->occupancy[word_index];
     }
+
+    i = word_index * 64 + __builtin_ctzll(word);
+    ASSERT(i < heap->heap_size);
     *iter = i;
-    return NULL;
+    return object_heap_get(heap, heap->bucket, i);
 }
 
 object_base_p
@@ -225,7 +399,7 @@ object_heap_next(object_heap_p heap, object_heap_iterator *iter)
 {
     object_base_p obj;
 
-    pthread_mutex_lock(&heap->mutex);
+    stats_mutex_lock(&heap->mutex);
     obj = object_heap_next_unlocked(heap, iter);
     pthread_mutex_unlock(&heap->mutex);
     return obj;
@@ -237,11 +411,16 @@ object_heap_next(object_heap_p heap, object_heap_iterator *iter)
 static void
 object_heap_free_unlocked(object_heap_p heap, object_base_p obj)
 {
+    const int index = obj->id & OBJECT_HEAP_INDEX_MASK;
+
     /* Check if the object has in fact been allocated */
     ASSERT(obj->next_free == ALLOCATED);
 
-    obj->next_free = heap->next_free;
-    heap->next_free = obj->id & OBJECT_HEAP_ID_MASK;
+    ATOMIC_STORE(&obj->next_free, heap->next_free);
+    ATOMIC_STORE(&obj->id, object_heap_get_next_id(heap, obj));
+    heap->occupancy[index / 64] &= ~(1ULL << (index % 64));
+    heap->next_free = index;
+    heap->num_allocated--;
 }
 
 void
@@ -249,11 +428,28 @@ object_heap_free(object_heap_p heap, object_base_p obj)
 {
     if (!obj)
         return;
-    pthread_mutex_lock(&heap->mutex);
+    stats_mutex_lock(&heap->mutex);
     object_heap_free_unlocked(heap, obj);
     pthread_mutex_unlock(&heap->mutex);
 }
 
+/*
+ * Assigns a new ID to an allocated object, so that its previous ID
+ * becomes stale while the object itself is kept for reuse
+ * Returns the new object ID
+ */
+int
+object_heap_renew(object_heap_p heap, object_base_p obj)
+{
+    const int id = object_heap_get_next_id(heap, obj);
+
+    /* Check if the object has in fact been allocated */
+    ASSERT(obj->next_free == ALLOCATED);
+
+    ATOMIC_STORE(&obj->id, id);
+    return id;
+}
+
 /*
  * Destroys a heap, the heap must be empty.
  */
@@ -261,23 +457,35 @@ void
 object_heap_destroy(object_heap_p heap)
 {
     object_base_p obj;
-    int bucket_index, obj_index, i;
+    int i;
 
     /* Check if heap is empty */
     for (i = 0; i < heap->heap_size; i++) {
         /* Check if object is not still allocated */
-        bucket_index = i / heap->heap_increment;
-        obj_index = i % heap->heap_increment;
-        obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
+        obj = object_heap_get(heap, heap->bucket, i);
         ASSERT(obj->next_free != ALLOCATED);
     }
 
-    for (i = 0; i < heap->heap_size / heap->heap_increment; i++) {
-        free(heap->bucket[i]);
+    free(heap->occupancy);
+    heap->occupancy = NULL;
+    heap->num_occupancy_words = 0;
+
+    for (i = 0; i < heap->num_slabs; i++) {
+        free(heap->slabs[i]);
     }
+    free(heap->slabs);
+    heap->slabs = NULL;
+    heap->num_slabs = 0;
 
     pthread_mutex_destroy(&heap->mutex);
 
+    for (i = 0; i < heap->num_retired_buckets; i++) {
+        free(heap->retired_buckets[i]);
+    }
+    free(heap->retired_buckets);
+    heap->retired_buckets = NULL;
+    heap->num_retired_buckets = 0;
+
     free(heap->bucket);
     heap->bucket = NULL;
     heap->heap_size = 0;
@@ -21,8 +21,21 @@
 #ifndef VA_OBJECT_HEAP_H
 #define VA_OBJECT_HEAP_H
 
-#define OBJECT_HEAP_OFFSET_MASK 0x7f000000
-#define OBJECT_HEAP_ID_MASK     0x00ffffff
+/*
+ * Object IDs are made of the heap offset (4 bits, up to 15 heaps), a
+ * generation number (11 bits) that is bumped every time the object is
+ * freed, and the object index within the heap (16 bits). Stale IDs thus
+ * fail to resolve until the same slot has been recycled 2048 times.
+ *
+ * A heap holds at most 65536 objects, object_heap_allocate() and
+ * object_heap_reserve() fail past that.
+ */
+#define OBJECT_HEAP_OFFSET_MASK         0x78000000
+#define OBJECT_HEAP_ID_MASK             0x07ffffff
+#define OBJECT_HEAP_GENERATION_MASK     0x07ff0000
+#define OBJECT_HEAP_GENERATION_SHIFT    16
+#define OBJECT_HEAP_INDEX_MASK          0x0000ffff
+#define OBJECT_HEAP_MAX_SIZE            (OBJECT_HEAP_INDEX_MASK + 1)
 
 typedef struct object_base *object_base_p;
 typedef struct object_heap *object_heap_p;
@@ -38,9 +51,16 @@ struct object_heap {
     int id_offset;
     int next_free;
     int heap_size;
-    int heap_increment;
+    int bucket_shift;
     void **bucket;
     int num_buckets;
+    void **retired_buckets;
+    int num_retired_buckets;
+    void **slabs;
+    int num_slabs;
+    int num_allocated;
+    uint64_t *occupancy;
+    int num_occupancy_words;
 };
 
 typedef int object_heap_iterator;
@@ -60,13 +80,48 @@ int object_heap_allocate(object_heap_p heap)
     attribute_hidden;
 
 /*
- * Lookup an allocated object by object ID
+ * Makes sure at least n objects can be allocated without expanding the heap
+ * Return 0 on success, -1 on error
+ */
+int
+object_heap_reserve(object_heap_p heap, int n)
+    attribute_hidden;
+
+/*
+ * Lookup an allocated object by object ID, without taking the heap lock
  * Returns a pointer to the object on success, returns NULL on error
  */
 object_base_p
 object_heap_lookup(object_heap_p heap, int id)
     attribute_hidden;
 
+/*
+ * Lookup an array of objects by object IDs, without taking the heap lock
+ * Objects that could not be found are set to NULL in objs[]
+ * Return 0 if all objects were found, -1 otherwise
+ */
+int
+object_heap_lookup_many(
+    object_heap_p      heap,
+    const int         *ids,
+    int                num_ids,
+    object_base_p     *objs
+) attribute_hidden;
+
+/*
+ * Locks the heap, e.g. to iterate over all objects at once
+ */
+void
+object_heap_lock(object_heap_p heap)
+    attribute_hidden;
+
+/*
+ * Unlocks the heap
+ */
+void
+object_heap_unlock(object_heap_p heap)
+    attribute_hidden;
+
 /*
  * Iterate over all objects in the heap.
  * Returns a pointer to the first object on the heap, returns NULL if heap is empty.
@@ -83,6 +138,18 @@ object_base_p
 object_heap_next(object_heap_p heap, object_heap_iterator *iter)
     attribute_hidden;
 
+/*
+ * Same as object_heap_first() and object_heap_next() but the caller
+ * holds the heap lock for the whole walk, see object_heap_lock().
+ */
+object_base_p
+object_heap_first_unlocked(object_heap_p heap, object_heap_iterator *iter)
+    attribute_hidden;
+
+object_base_p
+object_heap_next_unlocked(object_heap_p heap, object_heap_iterator *iter)
+    attribute_hidden;
+
 /*
  * Frees an object
  */
@@ -90,6 +157,15 @@ void
 object_heap_free(object_heap_p heap, object_base_p obj)
     attribute_hidden;
 
+/*
+ * Assigns a new ID to an allocated object, so that its previous ID
+ * becomes stale while the object itself is kept for reuse
+ * Returns the new object ID
+ */
+int
+object_heap_renew(object_heap_p heap, object_base_p obj)
+    attribute_hidden;
+
 /*
  * Destroys a heap, the heap must be empty.
  */
@@ -37,6 +37,11 @@
 #undef  ARRAY_ELEMS
 #define ARRAY_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
 
+// Atomic operations
+#define ATOMIC_LOAD(p)          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_ADD(p, v)        __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
 #ifdef HAVE_VISIBILITY_ATTRIBUTE
 # define attribute_hidden __attribute__((__visibility__("hidden")))
 #else
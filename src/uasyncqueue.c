@@ -22,6 +22,7 @@
 #include "uasyncqueue.h"
 #include "uqueue.h"
 #include <pthread.h>
+#include "debug.h"
 
 struct _UAsyncQueue {
     UQueue             *queue;
@@ -81,7 +82,7 @@ UAsyncQueue *async_queue_push(UAsyncQueue *queue, void *data)
     if (!queue)
         return NULL;
 
-    pthread_mutex_lock(&queue->mutex);
+    stats_mutex_lock(&queue->mutex);
     async_queue_push_unlocked(queue, data);
     pthread_mutex_unlock(&queue->mutex);
     return queue;
@@ -115,7 +116,7 @@ void *async_queue_timed_pop(UAsyncQueue *queue, uint64_t end_time)
     if (!queue)
         return NULL;
 
-    pthread_mutex_lock(&queue->mutex);
+    stats_mutex_lock(&queue->mutex);
     data = async_queue_timed_pop_unlocked(queue, end_time);
     pthread_mutex_unlock(&queue->mutex);
     return data;
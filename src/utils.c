@@ -78,6 +78,18 @@ uint64_t get_ticks_usec(void)
 #endif
 }
 
+// Get current value of monotonic nanosecond timer
+uint64_t get_ticks_nsec(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#else
+    return get_ticks_usec() * 1000;
+#endif
+}
+
 #if defined(__linux__)
 // Linux select() changes its timeout parameter upon return to contain
 // the remaining time. Most other unixen leave it unchanged or undefined.
@@ -170,6 +182,7 @@ realloc_buffer(
         return buffer;
 
     num_elements += 4;
+    stats_count_allocation();
     if ((buffer = realloc(buffer, num_elements * element_size)) == NULL) {
         free(*buffer_p);
         *buffer_p = NULL;
@@ -30,6 +30,9 @@ int getenv_yesno(const char *env, int *pval)
 uint64_t get_ticks_usec(void)
     attribute_hidden;
 
+uint64_t get_ticks_nsec(void)
+    attribute_hidden;
+
 void delay_usec(unsigned int usec)
     attribute_hidden;
 
@@ -33,6 +33,9 @@
 #ifndef VA_STATUS_ERROR_UNIMPLEMENTED
 #define VA_STATUS_ERROR_UNIMPLEMENTED   0x00000014
 #endif
+#ifndef VA_STATUS_ERROR_HW_BUSY
+#define VA_STATUS_ERROR_HW_BUSY         0x00000022
+#endif
 #ifndef VA_DISPLAY_X11
 #define VA_DISPLAY_X11                  1
 #endif
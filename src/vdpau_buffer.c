@@ -45,11 +45,59 @@ destroy_dead_va_buffers(
     for (i = 0; i < obj_context->dead_buffers_count; i++) {
         obj_buffer = VDPAU_BUFFER(obj_context->dead_buffers[i]);
         ASSERT(obj_buffer);
-        destroy_va_buffer(driver_data, obj_buffer);
+        recycle_va_buffer(driver_data, obj_context, obj_buffer);
     }
     obj_context->dead_buffers_count = 0;
 }
 
+// Destroy recycled VA buffers
+void
+destroy_recycled_va_buffers(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
+{
+    unsigned int i;
+
+    for (i = 0; i < obj_context->recycled_buffers_count; i++)
+        destroy_va_buffer(driver_data, obj_context->recycled_buffers[i]);
+    obj_context->recycled_buffers_count = 0;
+}
+
+// Reuse a recycled VA buffer object that fits the request
+static object_buffer_p
+reuse_va_buffer(
+    vdpau_driver_data_t *driver_data,
+    VAContextID          context,
+    VABufferType         buffer_type,
+    unsigned int         buffer_size
+)
+{
+    object_context_p obj_context;
+    object_buffer_p obj_buffer;
+    unsigned int i;
+
+    if (context == VA_INVALID_ID)
+        return NULL;
+
+    obj_context = VDPAU_CONTEXT(context);
+    if (!obj_context)
+        return NULL;
+
+    /* Look from the most recently retired buffer, which is most
+       likely to be still in cache */
+    for (i = obj_context->recycled_buffers_count; i-- > 0;) {
+        obj_buffer = obj_context->recycled_buffers[i];
+        if (obj_buffer->type == buffer_type &&
+            obj_buffer->buffer_size_max >= buffer_size) {
+            obj_context->recycled_buffers[i] =
+                obj_context->recycled_buffers[--obj_context->recycled_buffers_count];
+            return obj_buffer;
+        }
+    }
+    return NULL;
+}
+
 // Create VA buffer object
 object_buffer_p
 create_va_buffer(
@@ -63,6 +111,17 @@ create_va_buffer(
     VABufferID buffer_id;
     object_buffer_p obj_buffer;
 
+    obj_buffer = reuse_va_buffer(driver_data, context, buffer_type,
+                                 size * num_elements);
+    if (obj_buffer) {
+        obj_buffer->max_num_elements = num_elements;
+        obj_buffer->num_elements     = num_elements;
+        obj_buffer->buffer_size      = size * num_elements;
+        obj_buffer->mtime            = 0;
+        obj_buffer->delayed_destroy  = 0;
+        return obj_buffer;
+    }
+
     buffer_id = object_heap_allocate(&driver_data->buffer_heap);
     if (buffer_id == VA_INVALID_BUFFER)
         return NULL;
@@ -76,7 +135,9 @@ create_va_buffer(
     obj_buffer->max_num_elements = num_elements;
     obj_buffer->num_elements     = num_elements;
     obj_buffer->buffer_size      = size * num_elements;
-    obj_buffer->buffer_data      = malloc(obj_buffer->buffer_size);
+    obj_buffer->buffer_data      = buffer_pool_alloc(&driver_data->buffer_pool,
+                                                     obj_buffer->buffer_size,
+                                                     &obj_buffer->buffer_size_max);
     obj_buffer->mtime            = 0;
     obj_buffer->delayed_destroy  = 0;
 
@@ -98,12 +159,43 @@ destroy_va_buffer(
         return;
 
     if (obj_buffer->buffer_data) {
-        free(obj_buffer->buffer_data);
+        buffer_pool_free(&driver_data->buffer_pool,
+                         obj_buffer->buffer_data,
+                         obj_buffer->buffer_size_max);
         obj_buffer->buffer_data = NULL;
     }
     object_heap_free(&driver_data->buffer_heap, (object_base_p)obj_buffer);
 }
 
+// Retire VA buffer object so that vaCreateBuffer() can reuse it
+void
+recycle_va_buffer(
+    vdpau_driver_data_p driver_data,
+    object_context_p    obj_context,
+    object_buffer_p     obj_buffer
+)
+{
+    if (!obj_buffer)
+        return;
+
+    if (!obj_context ||
+        obj_context->recycled_buffers_count >= VDPAU_MAX_RECYCLED_BUFFERS ||
+        !realloc_buffer((void **)&obj_context->recycled_buffers,
+                        &obj_context->recycled_buffers_count_max,
+                        obj_context->recycled_buffers_count + 1,
+                        sizeof(*obj_context->recycled_buffers))) {
+        destroy_va_buffer(driver_data, obj_buffer);
+        return;
+    }
+
+    /* Keep the heap slot and payload, but invalidate the VABufferID
+       the application knows about */
+    object_heap_renew(&driver_data->buffer_heap, &obj_buffer->base);
+    obj_buffer->delayed_destroy = 0;
+    obj_context->recycled_buffers[obj_context->recycled_buffers_count++] =
+        obj_buffer;
+}
+
 // Schedule VA buffer object for destruction
 void
 schedule_destroy_va_buffer(
@@ -30,6 +30,7 @@ struct object_buffer {
     VABufferType        type;
     void               *buffer_data;
     unsigned int        buffer_size;
+    unsigned int        buffer_size_max;
     unsigned int        max_num_elements;
     unsigned int        num_elements;
     uint64_t            mtime;
@@ -43,6 +44,13 @@ destroy_dead_va_buffers(
     object_context_p     obj_context
 ) attribute_hidden;
 
+// Destroy recycled VA buffers
+void
+destroy_recycled_va_buffers(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
 // Create VA buffer object
 object_buffer_p
 create_va_buffer(
@@ -60,6 +68,14 @@ destroy_va_buffer(
     object_buffer_p     obj_buffer
 ) attribute_hidden;
 
+// Retire VA buffer object so that vaCreateBuffer() can reuse it
+void
+recycle_va_buffer(
+    vdpau_driver_data_p driver_data,
+    object_context_p    obj_context,
+    object_buffer_p     obj_buffer
+) attribute_hidden;
+
 // Schedule VA buffer object for destruction
 void
 schedule_destroy_va_buffer(
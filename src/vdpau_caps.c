@@ -0,0 +1,476 @@
+/*
+ *  vdpau_caps.c - VDPAU capabilities
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "sysdeps.h"
+#include "vdpau_caps.h"
+#include "vdpau_driver.h"
+
+#include "utils.h"
+#include <sys/stat.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define DEBUG 1
+#include "debug.h"
+
+/* Cache file header, followed by vdpau_caps_table_t */
+#define VDPAU_CAPS_CACHE_MAGIC          "VDPAUCAP"
+#define VDPAU_CAPS_CACHE_VERSION        1
+#define VDPAU_CAPS_CACHE_KEY_LENGTH     256
+
+typedef struct {
+    char                magic[8];
+    uint32_t            version;
+    uint32_t            table_size;
+    uint32_t            api_version;
+    char                key[VDPAU_CAPS_CACHE_KEY_LENGTH];
+} vdpau_caps_cache_header_t;
+
+typedef VdpStatus (*caps_query_func)(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         key,
+    vdpau_caps_entry_t  *entry
+);
+
+// Resets the capabilities table, entries are filled in on first use
+void
+vdpau_caps_init(vdpau_caps_t *caps)
+{
+    memset(caps, 0, sizeof(*caps));
+}
+
+// Check whether capabilities are cached on disk
+static int get_caps_cache_env(void)
+{
+    int caps_cache;
+    if (getenv_yesno("VDPAU_VIDEO_CAPS_CACHE", &caps_cache) < 0)
+        caps_cache = 1;
+    return caps_cache;
+}
+
+// FNV-1a hash of the cache key
+static uint32_t hash_string(const char *str)
+{
+    uint32_t hash = 2166136261U;
+
+    for (; *str; str++) {
+        hash ^= (uint8_t)*str;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// Returns the cache directory, creating it if needed
+static char *get_caps_cache_dir(void)
+{
+    const char *base_dir;
+    char *cache_dir, *dir;
+    size_t len;
+
+    base_dir = getenv("XDG_CACHE_HOME");
+    if (base_dir && base_dir[0] == '/')
+        cache_dir = strdup(base_dir);
+    else {
+        const char * const home_dir = getenv("HOME");
+        if (!home_dir || home_dir[0] != '/')
+            return NULL;
+        len = strlen(home_dir) + sizeof("/.cache");
+        cache_dir = malloc(len);
+        if (cache_dir)
+            snprintf(cache_dir, len, "%s/.cache", home_dir);
+    }
+    if (!cache_dir)
+        return NULL;
+    if (mkdir(cache_dir, 0700) < 0 && errno != EEXIST)
+        goto error;
+
+    len = strlen(cache_dir) + sizeof("/" PACKAGE_NAME);
+    dir = realloc(cache_dir, len);
+    if (!dir)
+        goto error;
+    cache_dir = dir;
+    strcat(cache_dir, "/" PACKAGE_NAME);
+    if (mkdir(cache_dir, 0700) < 0 && errno != EEXIST)
+        goto error;
+    return cache_dir;
+
+error:
+    free(cache_dir);
+    return NULL;
+}
+
+// Loads capabilities cached for that VDPAU implementation, if any
+void
+vdpau_caps_load(
+    vdpau_caps_t        *caps,
+    const char          *impl_string,
+    uint32_t             api_version
+)
+{
+    vdpau_caps_cache_header_t header;
+    vdpau_caps_table_t table;
+    char *cache_dir;
+    size_t len;
+    FILE *fp;
+
+    if (!get_caps_cache_env() || !impl_string ||
+        strlen(impl_string) >= VDPAU_CAPS_CACHE_KEY_LENGTH)
+        return;
+
+    cache_dir = get_caps_cache_dir();
+    if (!cache_dir)
+        return;
+
+    len = strlen(cache_dir) + sizeof("/caps-01234567-0123456789.bin");
+    caps->cache_file = malloc(len);
+    caps->cache_key  = strdup(impl_string);
+    if (!caps->cache_file || !caps->cache_key) {
+        free(caps->cache_file);
+        caps->cache_file = NULL;
+        free(caps->cache_key);
+        caps->cache_key = NULL;
+        free(cache_dir);
+        return;
+    }
+    snprintf(caps->cache_file, len, "%s/caps-%08x-%u.bin",
+             cache_dir, hash_string(impl_string), api_version);
+    caps->api_version = api_version;
+    free(cache_dir);
+
+    fp = fopen(caps->cache_file, "rb");
+    if (!fp)
+        return;
+    if (fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, VDPAU_CAPS_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version     == VDPAU_CAPS_CACHE_VERSION &&
+        header.table_size  == sizeof(table) &&
+        header.api_version == api_version &&
+        strncmp(header.key, impl_string, sizeof(header.key)) == 0 &&
+        fread(&table, sizeof(table), 1, fp) == 1) {
+        caps->table = table;
+        D(bug("loaded VDPAU capabilities from %s\n", caps->cache_file));
+    }
+    fclose(fp);
+}
+
+// Writes the table to a temporary file, then moves it into place so
+// that concurrent readers never see a partial file
+static int caps_save(vdpau_caps_t *caps)
+{
+    vdpau_caps_cache_header_t header;
+    char *tmp_file;
+    size_t len;
+    int fd, ok;
+    FILE *fp;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VDPAU_CAPS_CACHE_MAGIC, sizeof(header.magic));
+    header.version     = VDPAU_CAPS_CACHE_VERSION;
+    header.table_size  = sizeof(caps->table);
+    header.api_version = caps->api_version;
+    strncpy(header.key, caps->cache_key, sizeof(header.key) - 1);
+
+    len = strlen(caps->cache_file) + sizeof(".XXXXXX");
+    tmp_file = malloc(len);
+    if (!tmp_file)
+        return -1;
+    snprintf(tmp_file, len, "%s.XXXXXX", caps->cache_file);
+
+    fd = mkstemp(tmp_file);
+    if (fd < 0) {
+        free(tmp_file);
+        return -1;
+    }
+    fp = fdopen(fd, "wb");
+    if (!fp) {
+        close(fd);
+        unlink(tmp_file);
+        free(tmp_file);
+        return -1;
+    }
+    ok = (fwrite(&header, sizeof(header), 1, fp) == 1 &&
+          fwrite(&caps->table, sizeof(caps->table), 1, fp) == 1);
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (!ok || rename(tmp_file, caps->cache_file) < 0) {
+        unlink(tmp_file);
+        free(tmp_file);
+        return -1;
+    }
+    free(tmp_file);
+    return 0;
+}
+
+// Saves newly queried capabilities to the cache and releases resources
+void
+vdpau_caps_exit(vdpau_caps_t *caps)
+{
+    if (caps->cache_file && caps->cache_key && caps->is_dirty) {
+        if (caps_save(caps) < 0)
+            D(bug("failed to save VDPAU capabilities to %s\n", caps->cache_file));
+    }
+    free(caps->cache_file);
+    caps->cache_file = NULL;
+    free(caps->cache_key);
+    caps->cache_key = NULL;
+}
+
+// Looks up capabilities for key, querying VDPAU the first time only
+static VdpBool
+caps_lookup(
+    vdpau_caps_t        *caps,
+    vdpau_driver_data_t *driver_data,
+    vdpau_caps_entry_t  *table,
+    unsigned int         table_size,
+    unsigned int         key,
+    caps_query_func      query,
+    vdpau_caps_entry_t  *result
+)
+{
+    vdpau_caps_entry_t tmp_entry, *entry;
+
+    entry = key < table_size ? &table[key] : &tmp_entry;
+    if (entry == &tmp_entry || !ATOMIC_LOAD(&entry->is_known)) {
+        /* Failed queries are not remembered, nor saved to the cache,
+           so that a transient error does not hide the capability */
+        vdpau_caps_entry_t new_entry;
+        memset(&new_entry, 0, sizeof(new_entry));
+        if (query(driver_data, key, &new_entry) != VDP_STATUS_OK) {
+            if (result)
+                memset(result, 0, sizeof(*result));
+            return VDP_FALSE;
+        }
+
+        /* Concurrent fills store the same values */
+        entry->is_supported   = new_entry.is_supported;
+        entry->max_level      = new_entry.max_level;
+        entry->max_references = new_entry.max_references;
+        entry->max_width      = new_entry.max_width;
+        entry->max_height     = new_entry.max_height;
+        if (entry != &tmp_entry) {
+            ATOMIC_STORE(&entry->is_known, 1);
+            caps->is_dirty = 1;
+        }
+    }
+
+    if (result)
+        *result = *entry;
+    return entry->is_supported;
+}
+
+static VdpStatus
+query_decoder(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         profile,
+    vdpau_caps_entry_t  *entry
+)
+{
+    VdpBool is_supported = VDP_FALSE;
+    VdpStatus vdp_status;
+
+    vdp_status = vdpau_decoder_query_capabilities(
+        driver_data,
+        driver_data->vdp_device,
+        profile,
+        &is_supported,
+        &entry->max_level,
+        &entry->max_references,
+        &entry->max_width,
+        &entry->max_height
+    );
+    if (!VDPAU_CHECK_STATUS(vdp_status, "VdpDecoderQueryCapabilities()"))
+        return vdp_status;
+    entry->is_supported = is_supported;
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+query_ycbcr_format(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         format,
+    vdpau_caps_entry_t  *entry
+)
+{
+    VdpBool is_supported = VDP_FALSE;
+    VdpStatus vdp_status;
+
+    vdp_status = vdpau_video_surface_query_ycbcr_caps(
+        driver_data,
+        driver_data->vdp_device,
+        VDP_CHROMA_TYPE_420,
+        format,
+        &is_supported
+    );
+    entry->is_supported = vdp_status == VDP_STATUS_OK && is_supported;
+    return vdp_status;
+}
+
+static VdpStatus
+query_rgba_format(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         format,
+    vdpau_caps_entry_t  *entry
+)
+{
+    VdpBool is_supported = VDP_FALSE;
+    VdpStatus vdp_status;
+
+    vdp_status = vdpau_output_surface_query_rgba_caps(
+        driver_data,
+        driver_data->vdp_device,
+        format,
+        &is_supported
+    );
+    entry->is_supported = vdp_status == VDP_STATUS_OK && is_supported;
+    return vdp_status;
+}
+
+static VdpStatus
+query_bitmap_format(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         format,
+    vdpau_caps_entry_t  *entry
+)
+{
+    VdpBool is_supported = VDP_FALSE;
+    VdpStatus vdp_status;
+
+    vdp_status = vdpau_bitmap_surface_query_capabilities(
+        driver_data,
+        driver_data->vdp_device,
+        format,
+        &is_supported,
+        &entry->max_width,
+        &entry->max_height
+    );
+    entry->is_supported = vdp_status == VDP_STATUS_OK && is_supported;
+    return vdp_status;
+}
+
+static VdpStatus
+query_indexed_format(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         format,
+    vdpau_caps_entry_t  *entry
+)
+{
+    VdpBool is_supported = VDP_FALSE;
+    VdpStatus vdp_status;
+
+    vdp_status = vdpau_output_surface_query_put_bits_indexed_capabilities(
+        driver_data,
+        driver_data->vdp_device,
+        VDP_RGBA_FORMAT_B8G8R8A8,
+        format,
+        VDP_COLOR_TABLE_FORMAT_B8G8R8X8,
+        &is_supported
+    );
+    entry->is_supported = vdp_status == VDP_STATUS_OK && is_supported;
+    return vdp_status;
+}
+
+static VdpStatus
+query_mixer_feature(
+    vdpau_driver_data_t *driver_data,
+    unsigned int         feature,
+    vdpau_caps_entry_t  *entry
+)
+{
+    VdpBool is_supported = VDP_FALSE;
+    VdpStatus vdp_status;
+
+    vdp_status = vdpau_video_mixer_query_feature_support(
+        driver_data,
+        driver_data->vdp_device,
+        feature,
+        &is_supported
+    );
+    if (!VDPAU_CHECK_STATUS(vdp_status, "VdpVideoMixerQueryFeatureSupport()"))
+        return vdp_status;
+    entry->is_supported = is_supported;
+    return VDP_STATUS_OK;
+}
+
+#define CAPS_LOOKUP(name, key, query, result)                   \
+    caps_lookup(&driver_data->caps, driver_data,                \
+                driver_data->caps.table.name,                   \
+                ARRAY_ELEMS(driver_data->caps.table.name),      \
+                key, query, result)
+
+// Returns the decoder capabilities for the profile into *entry, if set
+VdpBool
+vdpau_caps_get_decoder(
+    vdpau_driver_data_t *driver_data,
+    VdpDecoderProfile    profile,
+    vdpau_caps_entry_t  *entry
+)
+{
+    return CAPS_LOOKUP(decoders, profile, query_decoder, entry);
+}
+
+// Checks whether video surfaces support get/put bits in that format
+VdpBool
+vdpau_caps_has_ycbcr_format(
+    vdpau_driver_data_t *driver_data,
+    VdpYCbCrFormat       format
+)
+{
+    return CAPS_LOOKUP(ycbcr_formats, format, query_ycbcr_format, NULL);
+}
+
+// Checks whether output surfaces support that format
+VdpBool
+vdpau_caps_has_rgba_format(
+    vdpau_driver_data_t *driver_data,
+    VdpRGBAFormat        format
+)
+{
+    return CAPS_LOOKUP(rgba_formats, format, query_rgba_format, NULL);
+}
+
+// Checks whether bitmap surfaces support that format
+VdpBool
+vdpau_caps_has_bitmap_format(
+    vdpau_driver_data_t *driver_data,
+    VdpRGBAFormat        format
+)
+{
+    return CAPS_LOOKUP(bitmap_formats, format, query_bitmap_format, NULL);
+}
+
+// Checks whether output surfaces support put bits in that indexed format
+VdpBool
+vdpau_caps_has_indexed_format(
+    vdpau_driver_data_t *driver_data,
+    VdpIndexedFormat     format
+)
+{
+    return CAPS_LOOKUP(indexed_formats, format, query_indexed_format, NULL);
+}
+
+// Checks whether the video mixer supports that feature
+VdpBool
+vdpau_caps_has_mixer_feature(
+    vdpau_driver_data_t *driver_data,
+    VdpVideoMixerFeature feature
+)
+{
+    return CAPS_LOOKUP(mixer_features, feature, query_mixer_feature, NULL);
+}
@@ -0,0 +1,123 @@
+/*
+ *  vdpau_caps.h - VDPAU capabilities
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef VDPAU_CAPS_H
+#define VDPAU_CAPS_H
+
+#include "vdpau_gate.h"
+
+/* Capabilities are indexed by the VDPAU enumeration value. Values past
+   the end of a table are queried on each request */
+#define VDPAU_CAPS_MAX_PROFILES         32
+#define VDPAU_CAPS_MAX_FORMATS          8
+#define VDPAU_CAPS_MAX_FEATURES         32
+
+typedef struct vdpau_caps_entry vdpau_caps_entry_t;
+struct vdpau_caps_entry {
+    uint32_t            is_known;
+    uint32_t            is_supported;
+    uint32_t            max_level;
+    uint32_t            max_references;
+    uint32_t            max_width;
+    uint32_t            max_height;
+};
+
+/* This is the layout of the on-disk cache too */
+typedef struct vdpau_caps_table vdpau_caps_table_t;
+struct vdpau_caps_table {
+    vdpau_caps_entry_t  decoders[VDPAU_CAPS_MAX_PROFILES];
+    vdpau_caps_entry_t  ycbcr_formats[VDPAU_CAPS_MAX_FORMATS];
+    vdpau_caps_entry_t  rgba_formats[VDPAU_CAPS_MAX_FORMATS];
+    vdpau_caps_entry_t  bitmap_formats[VDPAU_CAPS_MAX_FORMATS];
+    vdpau_caps_entry_t  indexed_formats[VDPAU_CAPS_MAX_FORMATS];
+    vdpau_caps_entry_t  mixer_features[VDPAU_CAPS_MAX_FEATURES];
+};
+
+typedef struct vdpau_caps vdpau_caps_t;
+struct vdpau_caps {
+    vdpau_caps_table_t  table;
+    unsigned int        is_dirty;
+    char               *cache_file;
+    char               *cache_key;
+    uint32_t            api_version;
+};
+
+// Resets the capabilities table, entries are filled in on first use
+void
+vdpau_caps_init(vdpau_caps_t *caps)
+    attribute_hidden;
+
+// Loads capabilities cached for that VDPAU implementation, if any
+void
+vdpau_caps_load(
+    vdpau_caps_t        *caps,
+    const char          *impl_string,
+    uint32_t             api_version
+) attribute_hidden;
+
+// Saves newly queried capabilities to the cache and releases resources
+void
+vdpau_caps_exit(vdpau_caps_t *caps)
+    attribute_hidden;
+
+// Returns the decoder capabilities for the profile into *entry, if set
+VdpBool
+vdpau_caps_get_decoder(
+    vdpau_driver_data_p  driver_data,
+    VdpDecoderProfile    profile,
+    vdpau_caps_entry_t  *entry
+) attribute_hidden;
+
+// Checks whether video surfaces support get/put bits in that format
+VdpBool
+vdpau_caps_has_ycbcr_format(
+    vdpau_driver_data_p  driver_data,
+    VdpYCbCrFormat       format
+) attribute_hidden;
+
+// Checks whether output surfaces support that format
+VdpBool
+vdpau_caps_has_rgba_format(
+    vdpau_driver_data_p  driver_data,
+    VdpRGBAFormat        format
+) attribute_hidden;
+
+// Checks whether bitmap surfaces support that format
+VdpBool
+vdpau_caps_has_bitmap_format(
+    vdpau_driver_data_p  driver_data,
+    VdpRGBAFormat        format
+) attribute_hidden;
+
+// Checks whether output surfaces support put bits in that indexed format
+VdpBool
+vdpau_caps_has_indexed_format(
+    vdpau_driver_data_p  driver_data,
+    VdpIndexedFormat     format
+) attribute_hidden;
+
+// Checks whether the video mixer supports that feature
+VdpBool
+vdpau_caps_has_mixer_feature(
+    vdpau_driver_data_p  driver_data,
+    VdpVideoMixerFeature feature
+) attribute_hidden;
+
+#endif /* VDPAU_CAPS_H */
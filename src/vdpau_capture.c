@@ -0,0 +1,301 @@
+/*
+ *  vdpau_capture.c - Binary decode capture
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "sysdeps.h"
+#include "vdpau_capture.h"
+#include "utils.h"
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+#define DEBUG 1
+#include "debug.h"
+
+/* The file is extended and mapped by chunks of that size */
+#define VDPAU_CAPTURE_CHUNK_SIZE        (16 << 20)
+
+/* Number of suffixes tried when another display already captures */
+#define VDPAU_CAPTURE_MAX_FILES         100
+
+#define ALIGN_UP(v, a)  (((v) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+// Unmaps the current window of the capture file
+static void capture_unmap(vdpau_capture_t *capture)
+{
+    if (capture->map) {
+        munmap(capture->map, capture->map_size);
+        capture->map      = NULL;
+        capture->map_size = 0;
+    }
+}
+
+// Makes sure size bytes can be written at the current offset
+static int capture_reserve(vdpau_capture_t *capture, size_t size)
+{
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t map_offset, map_size;
+    void *map;
+
+    if (capture->map &&
+        capture->offset + size <= capture->map_offset + capture->map_size)
+        return 0;
+
+    capture_unmap(capture);
+    map_offset = capture->offset & ~(page_size - 1);
+    map_size   = ALIGN_UP(capture->offset - map_offset + size, page_size);
+    if (map_size < VDPAU_CAPTURE_CHUNK_SIZE)
+        map_size = VDPAU_CAPTURE_CHUNK_SIZE;
+
+    /* Stores to a hole of a shared mapping raise SIGBUS once the disk
+       is full, so allocate the blocks now, while it can still fail */
+    if (posix_fallocate(capture->fd, map_offset, map_size) != 0)
+        return -1;
+    map = mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+               capture->fd, map_offset);
+    if (map == MAP_FAILED)
+        return -1;
+
+    capture->map        = map;
+    capture->map_offset = map_offset;
+    capture->map_size   = map_size;
+    return 0;
+}
+
+// Copies data at the current offset, which must have been reserved
+static inline void
+capture_write(vdpau_capture_t *capture, const void *data, size_t size)
+{
+    if (size == 0)
+        return;
+    memcpy(capture->map + (capture->offset - capture->map_offset), data, size);
+    capture->offset += size;
+}
+
+// Stops capturing after an I/O error
+static void capture_disable(vdpau_capture_t *capture)
+{
+    vdpau_error_message("failed to write decode capture, stopping\n");
+    capture->is_enabled = 0;
+}
+
+// Creates a capture file of its own for this process and display
+// Returns the file descriptor, or -1 on error
+static int capture_open(const char *prefix, char *filename, size_t size)
+{
+    const int pid = getpid();
+    int i, fd = -1;
+
+    /* Never clobber the capture of another process or display */
+    for (i = 0; fd < 0 && i < VDPAU_CAPTURE_MAX_FILES; i++) {
+        if (i == 0)
+            snprintf(filename, size, "%s.%d", prefix, pid);
+        else
+            snprintf(filename, size, "%s.%d.%d", prefix, pid, i);
+        fd = open(filename, O_RDWR|O_CREAT|O_EXCL, 0644);
+        if (fd < 0 && errno != EEXIST)
+            break;
+    }
+    return fd;
+}
+
+// Opens a capture file named after VDPAU_VIDEO_CAPTURE, if set
+void
+vdpau_capture_init(vdpau_capture_t *capture)
+{
+    vdpau_capture_header_t header;
+    const char *prefix;
+    char filename[PATH_MAX];
+
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = -1;
+
+    prefix = getenv("VDPAU_VIDEO_CAPTURE");
+    if (!prefix || !prefix[0])
+        return;
+
+    capture->fd = capture_open(prefix, filename, sizeof(filename));
+    if (capture->fd < 0) {
+        vdpau_error_message("failed to create decode capture file %s.%d\n",
+                            prefix, (int)getpid());
+        return;
+    }
+    pthread_mutex_init(&capture->lock, NULL);
+    capture->is_open    = 1;
+    capture->is_enabled = 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VDPAU_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version     = VDPAU_CAPTURE_VERSION;
+    header.header_size = sizeof(header);
+    if (capture_reserve(capture, sizeof(header)) < 0) {
+        capture_disable(capture);
+        return;
+    }
+    capture_write(capture, &header, sizeof(header));
+    D(bug("capturing decode calls to %s\n", filename));
+}
+
+// Trims the capture file to the recorded data and closes it
+void
+vdpau_capture_exit(vdpau_capture_t *capture)
+{
+    if (!capture->is_open)
+        return;
+
+    capture_unmap(capture);
+    if (ftruncate(capture->fd, capture->offset) < 0)
+        vdpau_error_message("failed to truncate decode capture file\n");
+    close(capture->fd);
+    capture->fd = -1;
+    pthread_mutex_destroy(&capture->lock);
+    capture->is_open    = 0;
+    capture->is_enabled = 0;
+}
+
+// Appends a record made of its arguments, a header and the data chunks
+static void
+capture_record(
+    vdpau_capture_t          *capture,
+    uint32_t                  type,
+    const void               *args,
+    uint32_t                  args_size,
+    const void               *header,
+    uint32_t                  header_size,
+    const VdpBitstreamBuffer *chunks,
+    uint32_t                  num_chunks
+)
+{
+    static const uint8_t padding[8];
+    vdpau_capture_record_t record;
+    uint64_t size;
+    uint32_t i;
+
+    size = sizeof(record) + args_size + header_size;
+    for (i = 0; i < num_chunks; i++)
+        size += chunks[i].bitstream_bytes;
+    if (ALIGN_UP(size, 8) > UINT32_MAX)
+        return;
+
+    record.record_size = ALIGN_UP(size, 8);
+    record.type        = type;
+    record.timestamp   = get_ticks_usec();
+
+    stats_mutex_lock(&capture->lock);
+    if (!capture->is_enabled)
+        goto end;
+    if (capture_reserve(capture, record.record_size) < 0) {
+        capture_disable(capture);
+        goto end;
+    }
+    capture_write(capture, &record, sizeof(record));
+    capture_write(capture, args, args_size);
+    capture_write(capture, header, header_size);
+    for (i = 0; i < num_chunks; i++)
+        capture_write(capture, chunks[i].bitstream, chunks[i].bitstream_bytes);
+    capture_write(capture, padding, record.record_size - size);
+end:
+    pthread_mutex_unlock(&capture->lock);
+}
+
+// Appends the start of a picture to the capture file
+void
+vdpau_capture_begin_picture(
+    vdpau_capture_t          *capture,
+    uint32_t                  context,
+    uint32_t                  va_profile,
+    uint32_t                  width,
+    uint32_t                  height
+)
+{
+    vdpau_capture_begin_picture_t args;
+
+    args.context    = context;
+    args.va_profile = va_profile;
+    args.width      = width;
+    args.height     = height;
+    capture_record(capture, VDPAU_CAPTURE_BEGIN_PICTURE,
+                   &args, sizeof(args), NULL, 0, NULL, 0);
+}
+
+// Appends a VA buffer passed to vaRenderPicture() to the capture file
+void
+vdpau_capture_va_buffer(
+    vdpau_capture_t          *capture,
+    uint32_t                  context,
+    uint32_t                  type,
+    uint32_t                  num_elements,
+    const void               *buffer,
+    uint32_t                  buffer_size
+)
+{
+    vdpau_capture_va_buffer_t args;
+    VdpBitstreamBuffer chunk;
+
+    args.context      = context;
+    args.type         = type;
+    args.num_elements = num_elements;
+    args.buffer_size  = buffer_size;
+
+    chunk.struct_version  = VDP_BITSTREAM_BUFFER_VERSION;
+    chunk.bitstream       = buffer;
+    chunk.bitstream_bytes = buffer_size;
+    capture_record(capture, VDPAU_CAPTURE_VA_BUFFER,
+                   &args, sizeof(args), NULL, 0, &chunk, 1);
+}
+
+// Appends the end of a picture to the capture file
+void
+vdpau_capture_end_picture(vdpau_capture_t *capture)
+{
+    capture_record(capture, VDPAU_CAPTURE_END_PICTURE,
+                   NULL, 0, NULL, 0, NULL, 0);
+}
+
+// Appends a VdpDecoderRender() call to the capture file
+void
+vdpau_capture_decode(
+    vdpau_capture_t          *capture,
+    VdpDecoderProfile         profile,
+    uint32_t                  width,
+    uint32_t                  height,
+    const void               *picture_info,
+    uint32_t                  picture_info_size,
+    const VdpBitstreamBuffer *bitstream_buffers,
+    uint32_t                  num_bitstream_buffers
+)
+{
+    vdpau_capture_decode_t args;
+    uint32_t i;
+
+    memset(&args, 0, sizeof(args));
+    args.profile           = profile;
+    args.width             = width;
+    args.height            = height;
+    args.picture_info_size = picture_info_size;
+    for (i = 0; i < num_bitstream_buffers; i++)
+        args.bitstream_size += bitstream_buffers[i].bitstream_bytes;
+
+    capture_record(capture, VDPAU_CAPTURE_DECODE,
+                   &args, sizeof(args), picture_info, picture_info_size,
+                   bitstream_buffers, num_bitstream_buffers);
+}
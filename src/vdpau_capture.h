@@ -0,0 +1,159 @@
+/*
+ *  vdpau_capture.h - Binary decode capture
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef VDPAU_CAPTURE_H
+#define VDPAU_CAPTURE_H
+
+#include "vdpau_gate.h"
+#include <pthread.h>
+
+/*
+ * Capture file layout, in host byte order:
+ *
+ *   vdpau_capture_header_t
+ *   vdpau_capture_record_t, followed by the record arguments and data,
+ *     padded to 8 bytes
+ *   ...
+ *
+ * A picture is recorded as BEGIN_PICTURE, one VA_BUFFER per buffer
+ * passed to vaRenderPicture(), DECODE if it reached the decoder, and
+ * END_PICTURE. VA buffers let the translation layer be replayed, and
+ * DECODE records let VDPAU be replayed on its own.
+ */
+#define VDPAU_CAPTURE_MAGIC             "VDPAUDEC"
+#define VDPAU_CAPTURE_VERSION           2
+
+enum {
+    VDPAU_CAPTURE_BEGIN_PICTURE = 1,    /* vdpau_capture_begin_picture_t */
+    VDPAU_CAPTURE_VA_BUFFER,            /* vdpau_capture_va_buffer_t + buffer data */
+    VDPAU_CAPTURE_DECODE,               /* vdpau_capture_decode_t + VdpPictureInfo + bitstream */
+    VDPAU_CAPTURE_END_PICTURE           /* no arguments */
+};
+
+typedef struct vdpau_capture_header vdpau_capture_header_t;
+struct vdpau_capture_header {
+    char                magic[8];
+    uint32_t            version;
+    uint32_t            header_size;
+};
+
+typedef struct vdpau_capture_record vdpau_capture_record_t;
+struct vdpau_capture_record {
+    uint32_t            record_size;
+    uint32_t            type;
+    uint64_t            timestamp;
+};
+
+typedef struct vdpau_capture_begin_picture vdpau_capture_begin_picture_t;
+struct vdpau_capture_begin_picture {
+    uint32_t            context;
+    uint32_t            va_profile;
+    uint32_t            width;
+    uint32_t            height;
+};
+
+typedef struct vdpau_capture_va_buffer vdpau_capture_va_buffer_t;
+struct vdpau_capture_va_buffer {
+    uint32_t            context;
+    uint32_t            type;
+    uint32_t            num_elements;
+    uint32_t            buffer_size;
+};
+
+typedef struct vdpau_capture_decode vdpau_capture_decode_t;
+struct vdpau_capture_decode {
+    uint32_t            profile;
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            picture_info_size;
+    uint32_t            bitstream_size;
+    uint32_t            reserved;
+};
+
+typedef struct vdpau_capture vdpau_capture_t;
+struct vdpau_capture {
+    unsigned int        is_enabled;
+    unsigned int        is_open;
+    pthread_mutex_t     lock;
+    int                 fd;
+    uint8_t            *map;
+    uint64_t            map_offset;
+    size_t              map_size;
+    uint64_t            offset;
+};
+
+// Opens a capture file named after VDPAU_VIDEO_CAPTURE, if set. The
+// process id, and a counter if needed, are appended to the name
+void
+vdpau_capture_init(vdpau_capture_t *capture)
+    attribute_hidden;
+
+// Trims the capture file to the recorded data and closes it
+void
+vdpau_capture_exit(vdpau_capture_t *capture)
+    attribute_hidden;
+
+// Appends the start of a picture to the capture file
+void
+vdpau_capture_begin_picture(
+    vdpau_capture_t          *capture,
+    uint32_t                  context,
+    uint32_t                  va_profile,
+    uint32_t                  width,
+    uint32_t                  height
+) attribute_hidden;
+
+// Appends a VA buffer passed to vaRenderPicture() to the capture file
+void
+vdpau_capture_va_buffer(
+    vdpau_capture_t          *capture,
+    uint32_t                  context,
+    uint32_t                  type,
+    uint32_t                  num_elements,
+    const void               *buffer,
+    uint32_t                  buffer_size
+) attribute_hidden;
+
+// Appends the end of a picture to the capture file
+void
+vdpau_capture_end_picture(vdpau_capture_t *capture)
+    attribute_hidden;
+
+// Appends a VdpDecoderRender() call to the capture file
+void
+vdpau_capture_decode(
+    vdpau_capture_t          *capture,
+    VdpDecoderProfile         profile,
+    uint32_t                  width,
+    uint32_t                  height,
+    const void               *picture_info,
+    uint32_t                  picture_info_size,
+    const VdpBitstreamBuffer *bitstream_buffers,
+    uint32_t                  num_bitstream_buffers
+) attribute_hidden;
+
+// Checks whether decode calls are being captured
+static inline int
+vdpau_capture_enabled(vdpau_capture_t *capture)
+{
+    return capture->is_enabled;
+}
+
+#endif /* VDPAU_CAPTURE_H */
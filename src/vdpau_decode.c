@@ -86,32 +86,91 @@ VdpDecoderProfile get_VdpDecoderProfile(VAProfile profile)
     return (VdpDecoderProfile)-1;
 }
 
-// Checks whether the VDPAU implementation supports the specified profile
+// Returns the profile of the same codec whose decoders also accept
+// streams of the specified profile, or (VdpDecoderProfile)-1
+static VdpDecoderProfile get_superset_profile(VdpDecoderProfile profile)
+{
+    switch (profile) {
+    case VDP_DECODER_PROFILE_MPEG2_SIMPLE:
+        return VDP_DECODER_PROFILE_MPEG2_MAIN;
+#if USE_VDPAU_MPEG4
+    case VDP_DECODER_PROFILE_MPEG4_PART2_SP:
+        return VDP_DECODER_PROFILE_MPEG4_PART2_ASP;
+#endif
+    /* VA-API Baseline streams are Constrained Baseline in practice */
+    case VDP_DECODER_PROFILE_H264_BASELINE:
+        return VDP_DECODER_PROFILE_H264_MAIN;
+    case VDP_DECODER_PROFILE_H264_MAIN:
+        return VDP_DECODER_PROFILE_H264_HIGH;
+    case VDP_DECODER_PROFILE_VC1_SIMPLE:
+        return VDP_DECODER_PROFILE_VC1_MAIN;
+    default:
+        break;
+    }
+    return (VdpDecoderProfile)-1;
+}
+
+static int get_profile_fallback_env(void)
+{
+    int profile_fallback;
+    if (getenv_yesno("VDPAU_VIDEO_PROFILE_FALLBACK", &profile_fallback) < 0)
+        profile_fallback = 0;
+    return profile_fallback;
+}
+
+static inline int profile_fallback_enabled(void)
+{
+    static int g_profile_fallback = -1;
+    if (g_profile_fallback < 0)
+        g_profile_fallback = get_profile_fallback_env();
+    return g_profile_fallback;
+}
+
+// Returns the VDPAU profile to decode streams of the specified profile
+// and size with, or (VdpDecoderProfile)-1. A zero size matches any size
+VdpDecoderProfile
+get_decoder_profile(
+    vdpau_driver_data_t *driver_data,
+    VdpDecoderProfile    profile,
+    uint32_t             width,
+    uint32_t             height
+)
+{
+    vdpau_caps_entry_t caps;
+
+    while (profile != (VdpDecoderProfile)-1) {
+        if (vdpau_caps_get_decoder(driver_data, profile, &caps) &&
+            width <= caps.max_width && height <= caps.max_height)
+            return profile;
+        if (!profile_fallback_enabled())
+            break;
+        profile = get_superset_profile(profile);
+    }
+    return (VdpDecoderProfile)-1;
+}
+
+// Checks whether the VDPAU implementation natively supports the specified profile
 static inline VdpBool
 is_supported_profile(
     vdpau_driver_data_t *driver_data,
     VdpDecoderProfile    profile
 )
 {
-    VdpBool is_supported = VDP_FALSE;
-    VdpStatus vdp_status;
-    uint32_t max_level, max_references, max_width, max_height;
-
     if (profile == (VdpDecoderProfile)-1)
         return VDP_FALSE;
 
-    vdp_status = vdpau_decoder_query_capabilities(
-        driver_data,
-        driver_data->vdp_device,
-        profile,
-        &is_supported,
-        &max_level,
-        &max_references,
-        &max_width,
-        &max_height
-    );
-    return (VDPAU_CHECK_STATUS(vdp_status, "VdpDecoderQueryCapabilities()") &&
-            is_supported);
+    return vdpau_caps_get_decoder(driver_data, profile, NULL);
+}
+
+// Checks whether streams of the specified profile can be decoded, natively
+// or through an opted-in superset profile fallback
+static inline VdpBool
+is_decodable_profile(
+    vdpau_driver_data_t *driver_data,
+    VdpDecoderProfile    profile
+)
+{
+    return get_decoder_profile(driver_data, profile, 0, 0) != (VdpDecoderProfile)-1;
 }
 
 // Checks decoder for profile/entrypoint is available
@@ -122,7 +181,7 @@ check_decoder(
     VAEntrypoint         entrypoint
 )
 {
-    if (!is_supported_profile(driver_data, get_VdpDecoderProfile(profile)))
+    if (!is_decodable_profile(driver_data, get_VdpDecoderProfile(profile)))
         return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
 
     /* VDPAU only supports VLD */
@@ -132,38 +191,530 @@ check_decoder(
     return VA_STATUS_SUCCESS;
 }
 
-// Computes value for VdpDecoderCreate()::max_references parameter
+// H.264 MaxDpbMbs limits, indexed by level_idc (Table A-1)
+typedef struct {
+    uint32_t level_idc;
+    uint32_t max_dpb_mbs;
+} h264_level_limits_t;
+
+static const h264_level_limits_t h264_level_limits[] = {
+    {  9,    396 }, /* 1b */
+    { 10,    396 },
+    { 11,    900 },
+    { 12,   2376 },
+    { 13,   2376 },
+    { 20,   2376 },
+    { 21,   4752 },
+    { 22,   8100 },
+    { 30,   8100 },
+    { 31,  18000 },
+    { 32,  20480 },
+    { 40,  32768 },
+    { 41,  32768 },
+    { 42,  34816 },
+    { 50, 110400 },
+    { 51, 184320 },
+    { 52, 184320 }
+};
+
+// Returns MaxDpbMbs for the H.264 level, 4.1 limits if it is unknown
+static unsigned int get_h264_max_dpb_mbs(uint32_t level_idc)
+{
+    unsigned int i, max_dpb_mbs = 32768;
+
+    if (level_idc == 0)
+        return max_dpb_mbs;
+
+    for (i = 0; i < ARRAY_ELEMS(h264_level_limits); i++) {
+        if (h264_level_limits[i].level_idc > level_idc)
+            break;
+        max_dpb_mbs = h264_level_limits[i].max_dpb_mbs;
+    }
+    return max_dpb_mbs;
+}
+
+// Computes value for VdpDecoderCreate()::max_references parameter, i.e.
+// the largest DPB the hardware level allows for the picture size
 static int
 get_max_ref_frames(
-    VdpDecoderProfile profile,
-    unsigned int      width,
-    unsigned int      height
+    vdpau_driver_data_t *driver_data,
+    VdpDecoderProfile    profile,
+    unsigned int         width,
+    unsigned int         height
 )
 {
     int max_ref_frames = 2;
 
     switch (profile) {
+    case VDP_DECODER_PROFILE_H264_BASELINE:
     case VDP_DECODER_PROFILE_H264_MAIN:
     case VDP_DECODER_PROFILE_H264_HIGH:
     {
-        /* level 4.1 limits */
-        unsigned int aligned_width  = (width + 15) & -16;
-        unsigned int aligned_height = (height + 15) & -16;
-        unsigned int surface_size   = (aligned_width * aligned_height * 3) / 2;
-        if ((max_ref_frames = (12 * 1024 * 1024) / surface_size) > 16)
+        vdpau_caps_entry_t caps;
+        uint32_t max_level = 0, max_references = 0;
+
+        if (vdpau_caps_get_decoder(driver_data, profile, &caps)) {
+            max_level      = caps.max_level;
+            max_references = caps.max_references;
+        }
+
+        unsigned int width_mbs  = (width  + 15) / 16;
+        unsigned int height_mbs = (height + 15) / 16;
+        unsigned int frame_mbs  = MAX(width_mbs * height_mbs, 1);
+        max_ref_frames = get_h264_max_dpb_mbs(max_level) / frame_mbs;
+        if (max_ref_frames > 16)
             max_ref_frames = 16;
+        if (max_references > 0 && max_ref_frames > max_references)
+            max_ref_frames = max_references;
+        if (max_ref_frames < 1)
+            max_ref_frames = 1;
         break;
     }
     }
     return max_ref_frames;
 }
 
-// Returns the maximum number of reference frames of a decode session
-static inline int get_num_ref_frames(object_context_p obj_context)
+// Returns the decoder max_references for the context, computed once
+static int get_context_max_ref_frames(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
 {
-    if (obj_context->vdp_codec == VDP_CODEC_H264)
-        return obj_context->vdp_picture_info.h264.num_ref_frames;
-    return 2;
+    if (obj_context->dpb_max_ref_frames < 0)
+        obj_context->dpb_max_ref_frames =
+            get_max_ref_frames(driver_data,
+                               obj_context->vdp_profile,
+                               obj_context->picture_width,
+                               obj_context->picture_height);
+    return obj_context->dpb_max_ref_frames;
+}
+
+// Check whether vaEndPicture() hands decoding over to a submission thread
+static int get_async_decode_env(void)
+{
+    int async_decode;
+    if (getenv_yesno("VDPAU_VIDEO_ASYNC_DECODE", &async_decode) < 0)
+        async_decode = 0;
+    return async_decode;
+}
+
+static inline int async_decode_enabled(void)
+{
+    static int g_async_decode = -1;
+    if (g_async_decode < 0)
+        g_async_decode = get_async_decode_env();
+    return g_async_decode;
+}
+
+// Snapshot of a picture to be submitted by the decode thread
+typedef struct async_decode_job async_decode_job_t;
+struct async_decode_job {
+    vdpau_driver_data_t *driver_data;
+    VdpDecoder           vdp_decoder;
+    VdpVideoSurface      vdp_surface;
+    object_surface_p     obj_surface;
+    VAContextID          va_context;
+    vdp_picture_info_t   vdp_picture_info;
+    VdpBitstreamBuffer   vdp_bitstream_buffer;
+    uint8_t             *bitstream;
+    unsigned int         bitstream_size_max;
+    uint64_t             seq;
+};
+
+// Sentinel job that terminates the decode thread
+static async_decode_job_t g_async_decode_quit_job;
+
+// Submit queued pictures to the VDPAU decoder, in order
+static void *async_decode_thread(void *arg)
+{
+    object_context_p const obj_context = arg;
+    async_decode_job_t *job;
+    VdpStatus vdp_status;
+
+    for (;;) {
+        job = async_queue_pop(obj_context->async_queue);
+        if (!job)
+            continue;
+        if (job == &g_async_decode_quit_job)
+            break;
+
+        vdpau_driver_data_t * const driver_data = job->driver_data;
+        vdp_status = vdpau_decoder_render(
+            driver_data,
+            job->vdp_decoder,
+            job->vdp_surface,
+            (VdpPictureInfo)&job->vdp_picture_info,
+            job->vdp_bitstream_buffer.bitstream_bytes > 0 ? 1 : 0,
+            &job->vdp_bitstream_buffer
+        );
+        VDPAU_CHECK_STATUS(vdp_status, "VdpDecoderRender()");
+        if (job->bitstream)
+            buffer_pool_free(&driver_data->buffer_pool,
+                             job->bitstream, job->bitstream_size_max);
+
+        /* Only the last decode of the surface defines its status */
+        object_surface_p const obj_surface = job->obj_surface;
+        stats_mutex_lock(&obj_context->async_lock);
+        if (obj_surface->va_context == job->va_context &&
+            obj_surface->decode_seq == job->seq)
+            obj_surface->decode_status = vdp_status;
+        obj_context->async_completed = job->seq;
+        pthread_cond_broadcast(&obj_context->async_cond);
+        pthread_mutex_unlock(&obj_context->async_lock);
+        free(job);
+    }
+    return NULL;
+}
+
+// Wait for the decode job seq to be submitted
+static void
+async_decode_wait(object_context_p obj_context, uint64_t seq)
+{
+    stats_mutex_lock(&obj_context->async_lock);
+    while (obj_context->async_completed < seq)
+        pthread_cond_wait(&obj_context->async_cond, &obj_context->async_lock);
+    pthread_mutex_unlock(&obj_context->async_lock);
+}
+
+// Queue the current picture for submission by the decode thread
+static VdpStatus
+async_decode_submit(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context,
+    object_surface_p     obj_surface
+)
+{
+    async_decode_job_t *job;
+    unsigned int i, bitstream_size = 0;
+    uint8_t *bitstream;
+
+    stats_count_allocation();
+    job = malloc(sizeof(*job));
+    if (!job)
+        return VDP_STATUS_RESOURCES;
+
+    for (i = 0; i < obj_context->vdp_bitstream_buffers_count; i++)
+        bitstream_size += obj_context->vdp_bitstream_buffers[i].bitstream_bytes;
+
+    job->bitstream = NULL;
+    job->bitstream_size_max = 0;
+    if (bitstream_size > 0) {
+        job->bitstream = buffer_pool_alloc(&driver_data->buffer_pool,
+                                           bitstream_size,
+                                           &job->bitstream_size_max);
+        if (!job->bitstream) {
+            free(job);
+            return VDP_STATUS_RESOURCES;
+        }
+    }
+
+    /* The bitstream is flattened, whatever the arena mode is */
+    bitstream = job->bitstream;
+    for (i = 0; i < obj_context->vdp_bitstream_buffers_count; i++) {
+        const VdpBitstreamBuffer * const vdp_bitstream_buffer =
+            &obj_context->vdp_bitstream_buffers[i];
+        memcpy(bitstream, vdp_bitstream_buffer->bitstream,
+               vdp_bitstream_buffer->bitstream_bytes);
+        bitstream += vdp_bitstream_buffer->bitstream_bytes;
+    }
+    job->vdp_bitstream_buffer.struct_version  = VDP_BITSTREAM_BUFFER_VERSION;
+    job->vdp_bitstream_buffer.bitstream       = job->bitstream;
+    job->vdp_bitstream_buffer.bitstream_bytes = bitstream_size;
+
+    job->driver_data      = driver_data;
+    job->vdp_decoder      = obj_context->vdp_decoder;
+    job->vdp_surface      = obj_surface->vdp_surface;
+    job->obj_surface      = obj_surface;
+    job->va_context       = obj_context->base.id;
+    job->vdp_picture_info = obj_context->vdp_picture_info;
+    job->seq              = ++obj_context->async_submitted;
+
+    stats_mutex_lock(&obj_context->async_lock);
+    obj_surface->decode_seq    = job->seq;
+    obj_surface->decode_status = VDP_STATUS_OK;
+    pthread_mutex_unlock(&obj_context->async_lock);
+    if (!async_queue_push(obj_context->async_queue, job)) {
+        if (job->bitstream)
+            buffer_pool_free(&driver_data->buffer_pool,
+                             job->bitstream, job->bitstream_size_max);
+        free(job);
+        return VDP_STATUS_ERROR;
+    }
+    return VDP_STATUS_OK;
+}
+
+// Starts the decode submission thread of the context, if enabled
+int
+async_decode_init(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
+{
+    obj_context->async_queue     = NULL;
+    obj_context->async_submitted = 0;
+    obj_context->async_completed = 0;
+
+    if (!async_decode_enabled())
+        return 0;
+
+    obj_context->async_queue = async_queue_new();
+    if (!obj_context->async_queue)
+        return -1;
+
+    pthread_mutex_init(&obj_context->async_lock, NULL);
+    pthread_cond_init(&obj_context->async_cond, NULL);
+    if (pthread_create(&obj_context->async_thread, NULL,
+                       async_decode_thread, obj_context) != 0) {
+        pthread_cond_destroy(&obj_context->async_cond);
+        pthread_mutex_destroy(&obj_context->async_lock);
+        async_queue_free(obj_context->async_queue);
+        obj_context->async_queue = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Flushes pending jobs and stops the decode submission thread
+void
+async_decode_exit(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
+{
+    if (!obj_context->async_queue)
+        return;
+
+    /* Jobs are processed in order, so the quit job flushes the queue */
+    async_queue_push(obj_context->async_queue, &g_async_decode_quit_job);
+    pthread_join(obj_context->async_thread, NULL);
+
+    pthread_cond_destroy(&obj_context->async_cond);
+    pthread_mutex_destroy(&obj_context->async_lock);
+    async_queue_free(obj_context->async_queue);
+    obj_context->async_queue = NULL;
+}
+
+// Checks whether the surface still has a decode job in flight
+int
+async_decode_is_pending(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    object_context_p obj_context;
+    int is_pending;
+
+    obj_context = VDPAU_CONTEXT(obj_surface->va_context);
+    if (!obj_context || !obj_context->async_queue)
+        return 0;
+
+    stats_mutex_lock(&obj_context->async_lock);
+    is_pending = obj_context->async_completed < obj_surface->decode_seq;
+    pthread_mutex_unlock(&obj_context->async_lock);
+    return is_pending;
+}
+
+// Returns the status of the last completed decode into the surface
+VAStatus
+async_decode_get_status(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    object_context_p obj_context;
+    VdpStatus vdp_status;
+
+    obj_context = VDPAU_CONTEXT(obj_surface->va_context);
+    if (!obj_context || !obj_context->async_queue)
+        return vdpau_get_VAStatus(obj_surface->decode_status);
+
+    stats_mutex_lock(&obj_context->async_lock);
+    vdp_status = obj_surface->decode_status;
+    pthread_mutex_unlock(&obj_context->async_lock);
+    return vdpau_get_VAStatus(vdp_status);
+}
+
+// Waits for the last decode job targetting the surface to be submitted
+VAStatus
+async_decode_sync(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    object_context_p obj_context;
+
+    obj_context = VDPAU_CONTEXT(obj_surface->va_context);
+    if (obj_context && obj_context->async_queue)
+        async_decode_wait(obj_context, obj_surface->decode_seq);
+    return async_decode_get_status(driver_data, obj_surface);
+}
+
+// Get the maximum number of idle decoders kept for reuse
+static int get_decoder_pool_size_env(void)
+{
+    int decoder_pool_size;
+    if (getenv_int("VDPAU_VIDEO_DECODER_POOL_SIZE", &decoder_pool_size) < 0)
+        decoder_pool_size = 4;
+    if (decoder_pool_size < 0)
+        decoder_pool_size = 0;
+    else if (decoder_pool_size > VDPAU_MAX_POOLED_DECODERS)
+        decoder_pool_size = VDPAU_MAX_POOLED_DECODERS;
+    return decoder_pool_size;
+}
+
+// Initializes the pool of idle VDPAU decoders
+void
+decoder_pool_init(vdpau_driver_data_t *driver_data)
+{
+    pthread_mutex_init(&driver_data->decoder_pool_lock, NULL);
+    driver_data->decoder_pool_count     = 0;
+    driver_data->decoder_pool_count_max = get_decoder_pool_size_env();
+}
+
+// Destroys all idle VDPAU decoders
+void
+decoder_pool_exit(vdpau_driver_data_t *driver_data)
+{
+    decoder_pool_flush(driver_data);
+    pthread_mutex_destroy(&driver_data->decoder_pool_lock);
+}
+
+// Destroys all idle VDPAU decoders, returns how many were destroyed
+unsigned int
+decoder_pool_flush(vdpau_driver_data_t *driver_data)
+{
+    VdpDecoder vdp_decoders[VDPAU_MAX_POOLED_DECODERS];
+    unsigned int i, n;
+
+    stats_mutex_lock(&driver_data->decoder_pool_lock);
+    n = driver_data->decoder_pool_count;
+    for (i = 0; i < n; i++)
+        vdp_decoders[i] = driver_data->decoder_pool[i].vdp_decoder;
+    driver_data->decoder_pool_count = 0;
+    driver_data->decoder_pool_evictions += n;
+    pthread_mutex_unlock(&driver_data->decoder_pool_lock);
+
+    for (i = 0; i < n; i++)
+        vdpau_decoder_destroy(driver_data, vdp_decoders[i]);
+    vdpau_sched_pooled(&driver_data->sched, -(int)n);
+    return n;
+}
+
+// Dumps decoder pool hit and miss counters
+void
+decoder_pool_dump_statistics(vdpau_driver_data_t *driver_data)
+{
+    if (driver_data->decoder_pool_hits == 0 &&
+        driver_data->decoder_pool_misses == 0)
+        return;
+
+    vdpau_information_message("decoder pool: %llu hits, %llu misses, "
+                              "%llu evictions\n",
+                              (unsigned long long)driver_data->decoder_pool_hits,
+                              (unsigned long long)driver_data->decoder_pool_misses,
+                              (unsigned long long)driver_data->decoder_pool_evictions);
+    vdpau_information_message("decoder pool: %llu recreations for more "
+                              "reference frames\n",
+                              (unsigned long long)driver_data->decoder_recreations);
+}
+
+// Attaches an idle decoder compatible with the context, if any
+int
+decoder_pool_acquire(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context,
+    int                  max_ref_frames
+)
+{
+    vdpau_pooled_decoder_t *pooled_decoder = NULL;
+    unsigned int i;
+
+    if (max_ref_frames < 0)
+        max_ref_frames = get_context_max_ref_frames(driver_data, obj_context);
+
+    stats_mutex_lock(&driver_data->decoder_pool_lock);
+
+    /* Pick the smallest decoder that fits, the most recent one on ties */
+    for (i = 0; i < driver_data->decoder_pool_count; i++) {
+        vdpau_pooled_decoder_t * const d = &driver_data->decoder_pool[i];
+        if (d->vdp_profile    != obj_context->vdp_profile  ||
+            d->width          != obj_context->picture_width ||
+            d->height         != obj_context->picture_height ||
+            d->max_ref_frames <  max_ref_frames)
+            continue;
+        if (!pooled_decoder ||
+            d->max_ref_frames < pooled_decoder->max_ref_frames ||
+            (d->max_ref_frames == pooled_decoder->max_ref_frames &&
+             d->last_used > pooled_decoder->last_used))
+            pooled_decoder = d;
+    }
+
+    if (!pooled_decoder) {
+        pthread_mutex_unlock(&driver_data->decoder_pool_lock);
+        return -1;
+    }
+
+    obj_context->vdp_decoder    = pooled_decoder->vdp_decoder;
+    obj_context->max_ref_frames = pooled_decoder->max_ref_frames;
+    *pooled_decoder = driver_data->decoder_pool[--driver_data->decoder_pool_count];
+    ++driver_data->decoder_pool_hits;
+    pthread_mutex_unlock(&driver_data->decoder_pool_lock);
+
+    /* The session of the decoder is now accounted to the context */
+    vdpau_sched_pooled(&driver_data->sched, -1);
+    return 0;
+}
+
+// Detaches the decoder from the context and keeps it for later reuse
+void
+decoder_pool_release(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
+{
+    vdpau_pooled_decoder_t *pooled_decoder;
+    VdpDecoder vdp_evicted_decoder = VDP_INVALID_HANDLE;
+    int pooled = 0;
+    unsigned int i;
+
+    if (obj_context->vdp_decoder == VDP_INVALID_HANDLE)
+        return;
+
+    /* Queued jobs still reference the decoder */
+    if (obj_context->async_queue)
+        async_decode_wait(obj_context, obj_context->async_submitted);
+
+    stats_mutex_lock(&driver_data->decoder_pool_lock);
+    if (driver_data->decoder_pool_count_max == 0)
+        vdp_evicted_decoder = obj_context->vdp_decoder;
+    else {
+        if (driver_data->decoder_pool_count < driver_data->decoder_pool_count_max) {
+            pooled_decoder = &driver_data->decoder_pool[driver_data->decoder_pool_count++];
+            pooled = 1;
+        }
+        else {
+            /* Evict the least recently used decoder */
+            pooled_decoder = &driver_data->decoder_pool[0];
+            for (i = 1; i < driver_data->decoder_pool_count; i++) {
+                if (driver_data->decoder_pool[i].last_used < pooled_decoder->last_used)
+                    pooled_decoder = &driver_data->decoder_pool[i];
+            }
+            vdp_evicted_decoder = pooled_decoder->vdp_decoder;
+            ++driver_data->decoder_pool_evictions;
+        }
+        pooled_decoder->vdp_decoder    = obj_context->vdp_decoder;
+        pooled_decoder->vdp_profile    = obj_context->vdp_profile;
+        pooled_decoder->width          = obj_context->picture_width;
+        pooled_decoder->height         = obj_context->picture_height;
+        pooled_decoder->max_ref_frames = obj_context->max_ref_frames;
+        pooled_decoder->last_used      = ++driver_data->decoder_pool_ticks;
+    }
+    pthread_mutex_unlock(&driver_data->decoder_pool_lock);
+
+    if (vdp_evicted_decoder != VDP_INVALID_HANDLE)
+        vdpau_decoder_destroy(driver_data, vdp_evicted_decoder);
+    obj_context->vdp_decoder = VDP_INVALID_HANDLE;
+    vdpau_sched_pooled(&driver_data->sched, pooled);
 }
 
 // Ensure VDPAU decoder is created for the specified number of reference frames
@@ -176,21 +727,21 @@ ensure_decoder_with_max_refs(
 {
     VdpStatus vdp_status;
 
-    if (max_ref_frames < 0)
-        max_ref_frames =
-            get_max_ref_frames(obj_context->vdp_profile,
-                               obj_context->picture_width,
-                               obj_context->picture_height);
+    /* Size the decoder for the largest DPB the hardware allows, so
+       that it is only recreated for out of spec streams */
+    max_ref_frames = MAX(max_ref_frames,
+                         get_context_max_ref_frames(driver_data, obj_context));
 
     if (obj_context->vdp_decoder == VDP_INVALID_HANDLE ||
         obj_context->max_ref_frames < max_ref_frames) {
-        obj_context->max_ref_frames = max_ref_frames;
-
-        if (obj_context->vdp_decoder != VDP_INVALID_HANDLE) {
-            vdpau_decoder_destroy(driver_data, obj_context->vdp_decoder);
-            obj_context->vdp_decoder = VDP_INVALID_HANDLE;
-        }
+        if (obj_context->vdp_decoder != VDP_INVALID_HANDLE)
+            ATOMIC_ADD(&driver_data->decoder_recreations, 1);
+        decoder_pool_release(driver_data, obj_context);
+        if (decoder_pool_acquire(driver_data, obj_context, max_ref_frames) == 0)
+            return VDP_STATUS_OK;
 
+        obj_context->max_ref_frames = max_ref_frames;
+        ATOMIC_ADD(&driver_data->decoder_pool_misses, 1);
         vdp_status = vdpau_decoder_create(
             driver_data,
             driver_data->vdp_device,
@@ -200,6 +751,19 @@ ensure_decoder_with_max_refs(
             max_ref_frames,
             &obj_context->vdp_decoder
         );
+
+        /* Idle decoders hold hardware sessions, give them up and retry */
+        if (vdp_status == VDP_STATUS_RESOURCES &&
+            decoder_pool_flush(driver_data) > 0)
+            vdp_status = vdpau_decoder_create(
+                driver_data,
+                driver_data->vdp_device,
+                obj_context->vdp_profile,
+                obj_context->picture_width,
+                obj_context->picture_height,
+                max_ref_frames,
+                &obj_context->vdp_decoder
+            );
         if (!VDPAU_CHECK_STATUS(vdp_status, "VdpDecoderCreate()"))
             return vdp_status;
     }
@@ -214,6 +778,7 @@ alloc_gen_slice_data(object_context_p obj_context, unsigned int size)
 
     if (obj_context->gen_slice_data_size + size > obj_context->gen_slice_data_size_max) {
         obj_context->gen_slice_data_size_max += size;
+        stats_count_allocation();
         gen_slice_data = realloc(obj_context->gen_slice_data,
                                  obj_context->gen_slice_data_size_max);
         if (!gen_slice_data)
@@ -243,6 +808,105 @@ alloc_VdpBitstreamBuffer(object_context_p obj_context)
     return &vdp_bitstream_buffers[obj_context->vdp_bitstream_buffers_count++];
 }
 
+// Check whether slice data is assembled into a contiguous bitstream arena
+static int get_bitstream_arena_env(void)
+{
+    int bitstream_arena;
+    if (getenv_yesno("VDPAU_VIDEO_BITSTREAM_ARENA", &bitstream_arena) < 0)
+        bitstream_arena = 1;
+    return bitstream_arena;
+}
+
+static inline int bitstream_arena_enabled(void)
+{
+    static int g_bitstream_arena = -1;
+    if (g_bitstream_arena < 0)
+        g_bitstream_arena = get_bitstream_arena_env();
+    return g_bitstream_arena;
+}
+
+// Resize the bitstream arena. Arena lives until vaDestroyContext()
+static int
+resize_bitstream_arena(object_context_p obj_context, unsigned int size)
+{
+    uint8_t *arena;
+
+    size = (size + VDPAU_BITSTREAM_ARENA_ALIGN - 1) & ~(VDPAU_BITSTREAM_ARENA_ALIGN - 1);
+    if (size < obj_context->bitstream_arena_size)
+        return 0;
+
+    stats_count_allocation();
+    arena = realloc(obj_context->bitstream_arena, size);
+    if (!arena)
+        return -1;
+    obj_context->bitstream_arena          = arena;
+    obj_context->bitstream_arena_size_max = size;
+
+    /* The single VdpBitstreamBuffer must follow the arena if it moved */
+    if (obj_context->vdp_bitstream_buffers_count > 0)
+        obj_context->vdp_bitstream_buffers[0].bitstream = arena;
+    return 0;
+}
+
+// Append hunk into the bitstream arena, exposed as one VdpBitstreamBuffer
+static int
+append_bitstream_arena(
+    object_context_p obj_context,
+    const uint8_t   *buffer,
+    uint32_t         buffer_size
+)
+{
+    VdpBitstreamBuffer *bitstream_buffer;
+    unsigned int size = obj_context->bitstream_arena_size + buffer_size;
+
+    if (size > obj_context->bitstream_arena_size_max) {
+        if (resize_bitstream_arena(obj_context,
+                                   MAX(size, 2 * obj_context->bitstream_arena_size_max)) < 0)
+            return -1;
+    }
+
+    if (obj_context->vdp_bitstream_buffers_count == 0) {
+        bitstream_buffer = alloc_VdpBitstreamBuffer(obj_context);
+        if (!bitstream_buffer)
+            return -1;
+        bitstream_buffer->struct_version = VDP_BITSTREAM_BUFFER_VERSION;
+        bitstream_buffer->bitstream      = obj_context->bitstream_arena;
+    }
+    else
+        bitstream_buffer = &obj_context->vdp_bitstream_buffers[0];
+
+    memcpy(obj_context->bitstream_arena + obj_context->bitstream_arena_size,
+           buffer, buffer_size);
+    obj_context->bitstream_arena_size = size;
+    bitstream_buffer->bitstream_bytes = size;
+    return 0;
+}
+
+// Record the size of the picture just decoded and adapt the arena capacity
+// to the peak of the last VDPAU_BITSTREAM_ARENA_HISTORY pictures
+static void
+update_bitstream_arena(object_context_p obj_context)
+{
+    unsigned int i, peak_size = 0, target_size;
+
+    if (!obj_context->bitstream_arena)
+        return;
+
+    i = obj_context->bitstream_arena_frame++ % VDPAU_BITSTREAM_ARENA_HISTORY;
+    obj_context->bitstream_arena_peaks[i] = obj_context->bitstream_arena_size;
+    obj_context->bitstream_arena_size = 0;
+
+    for (i = 0; i < VDPAU_BITSTREAM_ARENA_HISTORY; i++)
+        peak_size = MAX(peak_size, obj_context->bitstream_arena_peaks[i]);
+
+    /* Leave some headroom so that the next picture does not grow the
+       arena halfway, and give memory back once large pictures are gone */
+    target_size = peak_size + peak_size / 4;
+    if (obj_context->bitstream_arena_size_max < target_size ||
+        obj_context->bitstream_arena_size_max > 2 * target_size)
+        resize_bitstream_arena(obj_context, MAX(target_size, VDPAU_BITSTREAM_ARENA_ALIGN));
+}
+
 // Append VASliceDataBuffer hunk into VDPAU buffer
 static int
 append_VdpBitstreamBuffer(
@@ -253,6 +917,9 @@ append_VdpBitstreamBuffer(
 {
     VdpBitstreamBuffer *bitstream_buffer;
 
+    if (bitstream_arena_enabled())
+        return append_bitstream_arena(obj_context, buffer, buffer_size);
+
     bitstream_buffer = alloc_VdpBitstreamBuffer(obj_context);
     if (!bitstream_buffer)
         return -1;
@@ -353,10 +1020,93 @@ static inline int ilog2(uint32_t v)
     return r | (v >> 1);
 }
 
+// Returns the map slot where the surface lives, or the empty slot that
+// ends its probe sequence. Slots are picked from the object index, so
+// render targets allocated in a row never collide
+static inline vdpau_surface_map_entry_t *
+surface_map_lookup(object_context_p obj_context, VASurfaceID va_surface)
+{
+    vdpau_surface_map_entry_t * const map = obj_context->surface_map;
+    const unsigned int mask = obj_context->surface_map_mask;
+    unsigned int i = va_surface & OBJECT_HEAP_INDEX_MASK;
+
+    for (;; i++) {
+        vdpau_surface_map_entry_t * const entry = &map[i & mask];
+        if (entry->va_surface == va_surface ||
+            entry->va_surface == VA_INVALID_SURFACE)
+            return entry;
+    }
+}
+
+// Builds the render targets to VDPAU surfaces map of the context
+int
+surface_map_init(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
+{
+    unsigned int i, map_size;
+
+    /* Keep the map at most half full so that probe sequences are short */
+    map_size = 1U << (ilog2(2 * obj_context->num_render_targets + 1) + 1);
+    obj_context->surface_map = malloc(map_size * sizeof(obj_context->surface_map[0]));
+    if (!obj_context->surface_map)
+        return -1;
+    obj_context->surface_map_mask = map_size - 1;
+
+    for (i = 0; i < map_size; i++) {
+        obj_context->surface_map[i].va_surface  = VA_INVALID_SURFACE;
+        obj_context->surface_map[i].vdp_surface = VDP_INVALID_HANDLE;
+    }
+
+    for (i = 0; i < obj_context->num_render_targets; i++) {
+        const VASurfaceID va_surface = obj_context->render_targets[i];
+        object_surface_p obj_surface = VDPAU_SURFACE(va_surface);
+        vdpau_surface_map_entry_t *entry;
+
+        if (!obj_surface)
+            continue;
+        entry = surface_map_lookup(obj_context, va_surface);
+        entry->va_surface  = va_surface;
+        entry->vdp_surface = obj_surface->vdp_surface;
+    }
+    return 0;
+}
+
+// Destroys the render targets to VDPAU surfaces map of the context
+void
+surface_map_exit(object_context_p obj_context)
+{
+    free(obj_context->surface_map);
+    obj_context->surface_map      = NULL;
+    obj_context->surface_map_mask = 0;
+}
+
+// Drops the surface from the map of the context it is bound to
+void
+surface_map_remove(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    object_context_p obj_context = VDPAU_CONTEXT(obj_surface->va_context);
+    vdpau_surface_map_entry_t *entry;
+
+    if (!obj_context || !obj_context->surface_map)
+        return;
+
+    /* Keep the slot so that the probe sequences through it remain
+       valid, lookups then go through the surface heap and fail */
+    entry = surface_map_lookup(obj_context, obj_surface->base.id);
+    if (entry->va_surface == obj_surface->base.id)
+        entry->vdp_surface = VDP_INVALID_HANDLE;
+}
+
 // Translate VASurfaceID
 static int
 translate_VASurfaceID(
     vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context,
     VASurfaceID          va_surface,
     VdpVideoSurface     *vdp_surface
 )
@@ -368,6 +1118,17 @@ translate_VASurfaceID(
         return 1;
     }
 
+    /* Render targets of the context are resolved without locking */
+    if (obj_context->surface_map) {
+        const vdpau_surface_map_entry_t * const entry =
+            surface_map_lookup(obj_context, va_surface);
+        if (entry->va_surface == va_surface &&
+            entry->vdp_surface != VDP_INVALID_HANDLE) {
+            *vdp_surface = entry->vdp_surface;
+            return 1;
+        }
+    }
+
     obj_surface = VDPAU_SURFACE(va_surface);
     if (!obj_surface)
         return 0;
@@ -380,6 +1141,7 @@ translate_VASurfaceID(
 static int
 translate_VAPictureH264(
     vdpau_driver_data_t   *driver_data,
+    object_context_p       obj_context,
     const VAPictureH264   *va_pic,
     VdpReferenceFrameH264 *rf
 )
@@ -390,7 +1152,8 @@ translate_VAPictureH264(
         return 1;
     }
 
-    if (!translate_VASurfaceID(driver_data, va_pic->picture_id, &rf->surface))
+    if (!translate_VASurfaceID(driver_data, obj_context,
+                               va_pic->picture_id, &rf->surface))
         return 0;
     rf->is_long_term            = (va_pic->flags & VA_PICTURE_H264_LONG_TERM_REFERENCE) != 0;
     if ((va_pic->flags & (VA_PICTURE_H264_TOP_FIELD|VA_PICTURE_H264_BOTTOM_FIELD)) == 0) {
@@ -580,13 +1343,109 @@ translate_VASliceDataBuffer(
             return 0;
         return 1;
     }
-#endif
+#endif
+
+    if (append_VdpBitstreamBuffer(obj_context,
+                                  obj_buffer->buffer_data,
+                                  obj_buffer->buffer_size) < 0)
+        return 0;
+    return 1;
+}
+
+// Checks whether the IQ matrix is the one translated last. Otherwise,
+// records it so that the next identical one is skipped
+static int
+iq_matrix_is_unchanged(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context,
+    object_buffer_p      obj_buffer
+)
+{
+    const unsigned int size = obj_buffer->buffer_size;
+
+    /* The matrices are already in vdp_picture_info, which is kept
+       across pictures of the context */
+    if (size == obj_context->last_iq_matrix_size &&
+        memcmp(&obj_context->last_iq_matrix, obj_buffer->buffer_data, size) == 0) {
+        ATOMIC_ADD(&driver_data->iq_matrix_hits, 1);
+        return 1;
+    }
+    ATOMIC_ADD(&driver_data->iq_matrix_misses, 1);
+
+    if (size <= sizeof(obj_context->last_iq_matrix)) {
+        memcpy(&obj_context->last_iq_matrix, obj_buffer->buffer_data, size);
+        obj_context->last_iq_matrix_size = size;
+    }
+    else
+        obj_context->last_iq_matrix_size = 0;
+    return 0;
+}
+
+// Checks whether the H.264 sequence fields are the ones translated last
+static int
+seq_fields_are_unchanged(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context,
+    uint32_t             seq_fields
+)
+{
+    if (obj_context->last_seq_fields_valid &&
+        obj_context->last_seq_fields == seq_fields) {
+        ATOMIC_ADD(&driver_data->seq_fields_hits, 1);
+        return 1;
+    }
+    ATOMIC_ADD(&driver_data->seq_fields_misses, 1);
 
-    if (append_VdpBitstreamBuffer(obj_context,
-                                  obj_buffer->buffer_data,
-                                  obj_buffer->buffer_size) < 0)
-        return 0;
-    return 1;
+    obj_context->last_seq_fields       = seq_fields;
+    obj_context->last_seq_fields_valid = 1;
+    return 0;
+}
+
+// Dumps the time spent per picture in the decode entry points
+void
+decode_dump_statistics(vdpau_driver_data_t *driver_data)
+{
+    const uint64_t num_pictures = driver_data->decoded_pictures;
+    const uint64_t num_buffers  = driver_data->render_picture_buffers;
+
+    if (num_pictures == 0)
+        return;
+
+    vdpau_information_message("decode: %llu pictures, %.1f buffers per "
+                              "picture\n",
+                              (unsigned long long)num_pictures,
+                              (double)num_buffers / num_pictures);
+    vdpau_information_message("decode: %llu ns per picture in "
+                              "vaBeginPicture(), %llu in vaRenderPicture(), "
+                              "%llu in vaEndPicture()\n",
+                              (unsigned long long)(driver_data->begin_picture_ns / num_pictures),
+                              (unsigned long long)(driver_data->render_picture_ns / num_pictures),
+                              (unsigned long long)(driver_data->end_picture_ns / num_pictures));
+    vdpau_information_message("decode: %llu ns per buffer translation, "
+                              "%llu ns per picture in decoder submission\n",
+                              (unsigned long long)(num_buffers ? driver_data->render_picture_ns / num_buffers : 0),
+                              (unsigned long long)(driver_data->decoder_render_ns / num_pictures));
+    vdpau_information_message("decode: %.1f allocations and %.1f lock "
+                              "acquisitions per picture, all driver calls "
+                              "included\n",
+                              (double)g_stats_counters.allocations / num_pictures,
+                              (double)g_stats_counters.locks / num_pictures);
+}
+
+// Dumps how often parameter buffers matched the last translated ones
+void
+picture_info_dump_statistics(vdpau_driver_data_t *driver_data)
+{
+    if (driver_data->iq_matrix_hits || driver_data->iq_matrix_misses)
+        vdpau_information_message("picture info: IQ matrix %llu hits, "
+                                  "%llu misses\n",
+                                  (unsigned long long)driver_data->iq_matrix_hits,
+                                  (unsigned long long)driver_data->iq_matrix_misses);
+    if (driver_data->seq_fields_hits || driver_data->seq_fields_misses)
+        vdpau_information_message("picture info: sequence fields %llu hits, "
+                                  "%llu misses\n",
+                                  (unsigned long long)driver_data->seq_fields_hits,
+                                  (unsigned long long)driver_data->seq_fields_misses);
 }
 
 // Translate VAPictureParameterBufferMPEG2
@@ -600,12 +1459,12 @@ translate_VAPictureParameterBufferMPEG2(
     VdpPictureInfoMPEG1Or2 * const pic_info = &obj_context->vdp_picture_info.mpeg2;
     VAPictureParameterBufferMPEG2 * const pic_param = obj_buffer->buffer_data;
 
-    if (!translate_VASurfaceID(driver_data,
+    if (!translate_VASurfaceID(driver_data, obj_context,
                                pic_param->forward_reference_picture,
                                &pic_info->forward_reference))
         return 0;
 
-    if (!translate_VASurfaceID(driver_data,
+    if (!translate_VASurfaceID(driver_data, obj_context,
                                pic_param->backward_reference_picture,
                                &pic_info->backward_reference))
         return 0;
@@ -644,6 +1503,9 @@ translate_VAIQMatrixBufferMPEG2(
     const uint8_t *inter_matrix_lookup;
     int i;
 
+    if (iq_matrix_is_unchanged(driver_data, obj_context, obj_buffer))
+        return 1;
+
     if (iq_matrix->load_intra_quantiser_matrix) {
         intra_matrix = iq_matrix->intra_quantiser_matrix;
         intra_matrix_lookup = ff_zigzag_direct;
@@ -703,12 +1565,12 @@ translate_VAPictureParameterBufferMPEG4(
     if (pic_param->vol_fields.bits.short_video_header)
         return 0;
 
-    if (!translate_VASurfaceID(driver_data,
+    if (!translate_VASurfaceID(driver_data, obj_context,
                                pic_param->forward_reference_picture,
                                &pic_info->forward_reference))
         return 0;
 
-    if (!translate_VASurfaceID(driver_data,
+    if (!translate_VASurfaceID(driver_data, obj_context,
                                pic_param->backward_reference_picture,
                                &pic_info->backward_reference))
         return 0;
@@ -761,6 +1623,9 @@ translate_VAIQMatrixBufferMPEG4(
     const uint8_t *inter_matrix_lookup;
     int i;
 
+    if (iq_matrix_is_unchanged(driver_data, obj_context, obj_buffer))
+        return 1;
+
     if (iq_matrix->load_intra_quant_mat) {
         intra_matrix = iq_matrix->intra_quant_mat;
         intra_matrix_lookup = ff_zigzag_direct;
@@ -832,18 +1697,21 @@ translate_VAPictureParameterBufferH264(
     pic_info->chroma_qp_index_offset            = pic_param->chroma_qp_index_offset;
     pic_info->second_chroma_qp_index_offset     = pic_param->second_chroma_qp_index_offset;
     pic_info->pic_init_qp_minus26               = pic_param->pic_init_qp_minus26;
-    pic_info->log2_max_frame_num_minus4         = pic_param->seq_fields.bits.log2_max_frame_num_minus4;
-    pic_info->pic_order_cnt_type                = pic_param->seq_fields.bits.pic_order_cnt_type;
-    pic_info->log2_max_pic_order_cnt_lsb_minus4 = pic_param->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4;
-    pic_info->delta_pic_order_always_zero_flag  = pic_param->seq_fields.bits.delta_pic_order_always_zero_flag;
-    pic_info->direct_8x8_inference_flag         = pic_param->seq_fields.bits.direct_8x8_inference_flag;
+    if (!seq_fields_are_unchanged(driver_data, obj_context,
+                                  pic_param->seq_fields.value)) {
+        pic_info->log2_max_frame_num_minus4         = pic_param->seq_fields.bits.log2_max_frame_num_minus4;
+        pic_info->pic_order_cnt_type                = pic_param->seq_fields.bits.pic_order_cnt_type;
+        pic_info->log2_max_pic_order_cnt_lsb_minus4 = pic_param->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4;
+        pic_info->delta_pic_order_always_zero_flag  = pic_param->seq_fields.bits.delta_pic_order_always_zero_flag;
+        pic_info->direct_8x8_inference_flag         = pic_param->seq_fields.bits.direct_8x8_inference_flag;
+    }
     pic_info->entropy_coding_mode_flag          = pic_param->pic_fields.bits.entropy_coding_mode_flag;
     pic_info->pic_order_present_flag            = pic_param->pic_fields.bits.pic_order_present_flag;
     pic_info->deblocking_filter_control_present_flag = pic_param->pic_fields.bits.deblocking_filter_control_present_flag;
     pic_info->redundant_pic_cnt_present_flag    = pic_param->pic_fields.bits.redundant_pic_cnt_present_flag;
 
     for (i = 0; i < 16; i++) {
-        if (!translate_VAPictureH264(driver_data,
+        if (!translate_VAPictureH264(driver_data, obj_context,
                                      &pic_param->ReferenceFrames[i],
                                      &pic_info->referenceFrames[i]))
                 return 0;
@@ -863,6 +1731,9 @@ translate_VAIQMatrixBufferH264(
     VAIQMatrixBufferH264 * const iq_matrix = obj_buffer->buffer_data;
     int i, j;
 
+    if (iq_matrix_is_unchanged(driver_data, obj_context, obj_buffer))
+        return 1;
+
     if (sizeof(pic_info->scaling_lists_4x4) == sizeof(iq_matrix->ScalingList4x4))
         memcpy(pic_info->scaling_lists_4x4, iq_matrix->ScalingList4x4,
                sizeof(pic_info->scaling_lists_4x4));
@@ -897,6 +1768,14 @@ translate_VASliceParameterBufferH264(
     VASliceParameterBufferH264 * const slice_params = obj_buffer->buffer_data;
     VASliceParameterBufferH264 * const slice_param = &slice_params[obj_buffer->num_elements - 1];
 
+    /* The picture is intra if all its slices are I or SI slices */
+    unsigned int i;
+    for (i = 0; i < obj_buffer->num_elements; i++) {
+        if (slice_params[i].slice_type % 5 != 2 &&
+            slice_params[i].slice_type % 5 != 4)
+            obj_context->picture_is_intra = 0;
+    }
+
     pic_info->slice_count                 += obj_buffer->num_elements;
     pic_info->num_ref_idx_l0_active_minus1 = slice_param->num_ref_idx_l0_active_minus1;
     pic_info->num_ref_idx_l1_active_minus1 = slice_param->num_ref_idx_l1_active_minus1;
@@ -917,12 +1796,12 @@ translate_VAPictureParameterBufferVC1(
     VAPictureParameterBufferVC1 * const pic_param = obj_buffer->buffer_data;
     int picture_type, major_version, minor_version;
 
-    if (!translate_VASurfaceID(driver_data,
+    if (!translate_VASurfaceID(driver_data, obj_context,
                                pic_param->forward_reference_picture,
                                &pic_info->forward_reference))
         return 0;
 
-    if (!translate_VASurfaceID(driver_data,
+    if (!translate_VASurfaceID(driver_data, obj_context,
                                pic_param->backward_reference_picture,
                                &pic_info->backward_reference))
         return 0;
@@ -992,13 +1871,332 @@ typedef int
                            object_context_p    obj_context,
                            object_buffer_p     obj_buffer);
 
-typedef struct translate_buffer_info translate_buffer_info_t;
-struct translate_buffer_info {
-    VdpCodec codec;
-    VABufferType type;
-    translate_buffer_func_t func;
+/* Buffer types that can be submitted for decoding */
+#define VDPAU_MAX_BUFFER_TYPES (VASliceDataBufferType + 1)
+
+// Codec specific decoding hooks
+struct vdpau_codec_ops {
+    VdpCodec                    codec;
+    translate_buffer_func_t     translate_buffer[VDPAU_MAX_BUFFER_TYPES];
+    void                      (*begin_picture)(object_context_p obj_context);
+    int                       (*get_num_ref_frames)(object_context_p obj_context);
+    void                      (*dump_picture_info)(object_context_p obj_context);
+    int                       (*is_reference_picture)(object_context_p obj_context);
+    int                       (*is_intra_picture)(object_context_p obj_context);
+    unsigned int                preserve_pic_param;
+};
+
+// Resets the MPEG-1/2 picture info for a new picture
+static void
+begin_picture_MPEG2(object_context_p obj_context)
+{
+    obj_context->vdp_picture_info.mpeg2.slice_count = 0;
+}
+
+// Dumps the MPEG-1/2 picture info
+static void
+dump_picture_info_MPEG2(object_context_p obj_context)
+{
+    dump_VdpPictureInfoMPEG1Or2(&obj_context->vdp_picture_info.mpeg2);
+}
+
+// Checks whether the MPEG-1/2 picture is not a B picture
+static int
+is_reference_picture_MPEG2(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.mpeg2.picture_coding_type != 3;
+}
+
+// Checks whether the MPEG-1/2 picture is an I picture
+static int
+is_intra_picture_MPEG2(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.mpeg2.picture_coding_type == 1;
+}
+
+#if HAVE_VDPAU_MPEG4
+// Dumps the MPEG-4 picture info
+static void
+dump_picture_info_MPEG4(object_context_p obj_context)
+{
+    dump_VdpPictureInfoMPEG4Part2(&obj_context->vdp_picture_info.mpeg4);
+}
+
+// Checks whether the MPEG-4 picture is not a B-VOP
+static int
+is_reference_picture_MPEG4(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.mpeg4.vop_coding_type != 2;
+}
+
+// Checks whether the MPEG-4 picture is an I-VOP
+static int
+is_intra_picture_MPEG4(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.mpeg4.vop_coding_type == 0;
+}
+#endif
+
+// Resets the H.264 picture info for a new picture
+static void
+begin_picture_H264(object_context_p obj_context)
+{
+    obj_context->vdp_picture_info.h264.slice_count = 0;
+    obj_context->picture_is_intra = 1;
+}
+
+// Checks whether the H.264 picture is used for reference
+static int
+is_reference_picture_H264(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.h264.is_reference;
+}
+
+// Checks whether the H.264 picture only has I or SI slices
+static int
+is_intra_picture_H264(object_context_p obj_context)
+{
+    return obj_context->picture_is_intra;
+}
+
+// Returns the number of reference frames of the H.264 picture
+static int
+get_num_ref_frames_H264(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.h264.num_ref_frames;
+}
+
+// Dumps the H.264 picture info
+static void
+dump_picture_info_H264(object_context_p obj_context)
+{
+    dump_VdpPictureInfoH264(&obj_context->vdp_picture_info.h264);
+}
+
+// Resets the VC-1 picture info for a new picture
+static void
+begin_picture_VC1(object_context_p obj_context)
+{
+    obj_context->vdp_picture_info.vc1.slice_count = 0;
+}
+
+// Dumps the VC-1 picture info
+static void
+dump_picture_info_VC1(object_context_p obj_context)
+{
+    dump_VdpPictureInfoVC1(&obj_context->vdp_picture_info.vc1);
+}
+
+// Checks whether the VC-1 picture is an I or P picture
+static int
+is_reference_picture_VC1(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.vc1.picture_type <= 1;
+}
+
+// Checks whether the VC-1 picture is an I picture
+static int
+is_intra_picture_VC1(object_context_p obj_context)
+{
+    return obj_context->vdp_picture_info.vc1.picture_type == 0;
+}
+
+static const vdpau_codec_ops_t vdpau_codec_ops_MPEG2 = {
+    .codec                      = VDP_CODEC_MPEG2,
+    .translate_buffer           = {
+        [VAPictureParameterBufferType]  = translate_VAPictureParameterBufferMPEG2,
+        [VAIQMatrixBufferType]          = translate_VAIQMatrixBufferMPEG2,
+        [VASliceParameterBufferType]    = translate_VASliceParameterBufferMPEG2,
+        [VASliceDataBufferType]         = translate_VASliceDataBuffer,
+    },
+    .begin_picture              = begin_picture_MPEG2,
+    .dump_picture_info          = dump_picture_info_MPEG2,
+    .is_reference_picture       = is_reference_picture_MPEG2,
+    .is_intra_picture           = is_intra_picture_MPEG2,
+};
+
+static const vdpau_codec_ops_t vdpau_codec_ops_MPEG4 = {
+    .codec                      = VDP_CODEC_MPEG4,
+    .translate_buffer           = {
+#if USE_VDPAU_MPEG4
+        [VAPictureParameterBufferType]  = translate_VAPictureParameterBufferMPEG4,
+        [VAIQMatrixBufferType]          = translate_VAIQMatrixBufferMPEG4,
+        [VASliceParameterBufferType]    = translate_VASliceParameterBufferMPEG4,
+#endif
+        [VASliceDataBufferType]         = translate_VASliceDataBuffer,
+    },
+#if HAVE_VDPAU_MPEG4
+    .dump_picture_info          = dump_picture_info_MPEG4,
+    .is_reference_picture       = is_reference_picture_MPEG4,
+    .is_intra_picture           = is_intra_picture_MPEG4,
+#endif
+    /* The slice data translator needs it to build the VOP header */
+    .preserve_pic_param         = 1,
+};
+
+static const vdpau_codec_ops_t vdpau_codec_ops_H264 = {
+    .codec                      = VDP_CODEC_H264,
+    .translate_buffer           = {
+        [VAPictureParameterBufferType]  = translate_VAPictureParameterBufferH264,
+        [VAIQMatrixBufferType]          = translate_VAIQMatrixBufferH264,
+        [VASliceParameterBufferType]    = translate_VASliceParameterBufferH264,
+        [VASliceDataBufferType]         = translate_VASliceDataBuffer,
+    },
+    .begin_picture              = begin_picture_H264,
+    .get_num_ref_frames         = get_num_ref_frames_H264,
+    .dump_picture_info          = dump_picture_info_H264,
+    .is_reference_picture       = is_reference_picture_H264,
+    .is_intra_picture           = is_intra_picture_H264,
+};
+
+static const vdpau_codec_ops_t vdpau_codec_ops_VC1 = {
+    .codec                      = VDP_CODEC_VC1,
+    .translate_buffer           = {
+        [VAPictureParameterBufferType]  = translate_VAPictureParameterBufferVC1,
+        [VABitPlaneBufferType]          = translate_nothing,
+        [VASliceParameterBufferType]    = translate_VASliceParameterBufferVC1,
+        [VASliceDataBufferType]         = translate_VASliceDataBuffer,
+    },
+    .begin_picture              = begin_picture_VC1,
+    .dump_picture_info          = dump_picture_info_VC1,
+    .is_reference_picture       = is_reference_picture_VC1,
+    .is_intra_picture           = is_intra_picture_VC1,
 };
 
+// Returns the decoding hooks for the codec
+const vdpau_codec_ops_t *get_codec_ops(VdpCodec codec)
+{
+    switch (codec) {
+    case VDP_CODEC_MPEG1:
+    case VDP_CODEC_MPEG2:
+        return &vdpau_codec_ops_MPEG2;
+    case VDP_CODEC_MPEG4:
+        return &vdpau_codec_ops_MPEG4;
+    case VDP_CODEC_H264:
+        return &vdpau_codec_ops_H264;
+    case VDP_CODEC_VC1:
+        return &vdpau_codec_ops_VC1;
+    }
+    return NULL;
+}
+
+// Returns the maximum number of reference frames of a decode session
+static inline int get_num_ref_frames(object_context_p obj_context)
+{
+    const vdpau_codec_ops_t * const codec_ops = obj_context->codec_ops;
+
+    if (codec_ops->get_num_ref_frames)
+        return codec_ops->get_num_ref_frames(obj_context);
+    return 2;
+}
+
+// Checks the value of a VDPAU_CONFIG_ATTRIB_DECODE_POLICY attribute
+VAStatus
+check_decode_policy(uint32_t value)
+{
+    switch (value & 0xff) {
+    case VDP_DECODE_POLICY_ALL:
+    case VDP_DECODE_POLICY_SKIP_NON_REFERENCE:
+    case VDP_DECODE_POLICY_KEYFRAMES:
+        return VA_STATUS_SUCCESS;
+    case VDP_DECODE_POLICY_EVERY_NTH:
+        if ((value >> 8) > 0)
+            return VA_STATUS_SUCCESS;
+        break;
+    }
+    return VA_STATUS_ERROR_INVALID_PARAMETER;
+}
+
+// Parses VDPAU_VIDEO_DECODE_POLICY: "all", "non-reference", "keyframes",
+// or N to decode non-reference pictures every Nth picture only
+static uint32_t get_decode_policy_env(void)
+{
+    const char *env_str = getenv("VDPAU_VIDEO_DECODE_POLICY");
+    char *end;
+    long n;
+
+    if (!env_str || strcmp(env_str, "all") == 0)
+        return VDP_DECODE_POLICY_ALL;
+    if (strcmp(env_str, "non-reference") == 0)
+        return VDP_DECODE_POLICY_SKIP_NON_REFERENCE;
+    if (strcmp(env_str, "keyframes") == 0)
+        return VDP_DECODE_POLICY_KEYFRAMES;
+
+    n = strtol(env_str, &end, 10);
+    if (end != env_str && *end == '\0' && n > 0 && n <= 0xffffff)
+        return VDP_DECODE_POLICY_EVERY_NTH | (n << 8);
+
+    vdpau_error_message("invalid VDPAU_VIDEO_DECODE_POLICY value '%s'\n",
+                        env_str);
+    return VDP_DECODE_POLICY_ALL;
+}
+
+// Sets the decode policy of the context from its config or the environment
+void
+decode_policy_init(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
+{
+    static uint32_t g_decode_policy = (uint32_t)-1;
+    uint32_t value;
+    int i;
+
+    if (g_decode_policy == (uint32_t)-1)
+        g_decode_policy = get_decode_policy_env();
+    value = g_decode_policy;
+
+    object_config_p obj_config = VDPAU_CONFIG(obj_context->config_id);
+    if (obj_config) {
+        for (i = 0; i < obj_config->attrib_count; i++) {
+            if (obj_config->attrib_list[i].type == VDPAU_CONFIG_ATTRIB_DECODE_POLICY)
+                value = obj_config->attrib_list[i].value;
+        }
+    }
+
+    obj_context->decode_policy       = value & 0xff;
+    obj_context->decode_policy_n     = value >> 8;
+    obj_context->decode_policy_count = 0;
+    obj_context->picture_is_intra    = 0;
+}
+
+// Checks whether the decode policy drops the current picture
+static int
+decode_policy_skips_picture(object_context_p obj_context)
+{
+    const vdpau_codec_ops_t * const codec_ops = obj_context->codec_ops;
+    unsigned int count;
+
+    if (obj_context->decode_policy == VDP_DECODE_POLICY_ALL ||
+        !codec_ops->is_reference_picture || !codec_ops->is_intra_picture)
+        return 0;
+
+    count = obj_context->decode_policy_count++;
+    switch (obj_context->decode_policy) {
+    case VDP_DECODE_POLICY_SKIP_NON_REFERENCE:
+        return !codec_ops->is_reference_picture(obj_context);
+    case VDP_DECODE_POLICY_KEYFRAMES:
+        return !codec_ops->is_intra_picture(obj_context);
+    case VDP_DECODE_POLICY_EVERY_NTH:
+        return (!codec_ops->is_reference_picture(obj_context) &&
+                count % obj_context->decode_policy_n != 0);
+    default:
+        break;
+    }
+    return 0;
+}
+
+// Dumps how many pictures the decode policies dropped
+void
+decode_policy_dump_statistics(vdpau_driver_data_t *driver_data)
+{
+    if (driver_data->skipped_pictures == 0)
+        return;
+
+    vdpau_information_message("decode policy: %llu pictures skipped\n",
+                              (unsigned long long)driver_data->skipped_pictures);
+}
+
 static int
 translate_buffer(
     vdpau_driver_data_t *driver_data,
@@ -1006,36 +2204,14 @@ translate_buffer(
     object_buffer_p     obj_buffer
 )
 {
-    static const translate_buffer_info_t translate_info[] = {
-#define _(CODEC, TYPE)                                  \
-        { VDP_CODEC_##CODEC, VA##TYPE##BufferType,      \
-          translate_VA##TYPE##Buffer##CODEC }
-        _(MPEG2, PictureParameter),
-        _(MPEG2, IQMatrix),
-        _(MPEG2, SliceParameter),
-#if USE_VDPAU_MPEG4
-        _(MPEG4, PictureParameter),
-        _(MPEG4, IQMatrix),
-        _(MPEG4, SliceParameter),
-#endif
-        _(H264, PictureParameter),
-        _(H264, IQMatrix),
-        _(H264, SliceParameter),
-        _(VC1, PictureParameter),
-        _(VC1, SliceParameter),
-#undef _
-        { VDP_CODEC_VC1, VABitPlaneBufferType, translate_nothing },
-        { 0, VASliceDataBufferType, translate_VASliceDataBuffer },
-        { 0, 0, NULL }
-    };
-    const translate_buffer_info_t *tbip;
-    for (tbip = translate_info; tbip->func != NULL; tbip++) {
-        if (tbip->codec && tbip->codec != obj_context->vdp_codec)
-            continue;
-        if (tbip->type != obj_buffer->type)
-            continue;
-        return tbip->func(driver_data, obj_context, obj_buffer);
-    }
+    const vdpau_codec_ops_t * const codec_ops = obj_context->codec_ops;
+    translate_buffer_func_t func = NULL;
+
+    if ((unsigned int)obj_buffer->type < VDPAU_MAX_BUFFER_TYPES)
+        func = codec_ops->translate_buffer[obj_buffer->type];
+    if (func)
+        return func(driver_data, obj_context, obj_buffer);
+
     D(bug("ERROR: no translate function found for %s%s\n",
           string_of_VABufferType(obj_buffer->type),
           obj_context->vdp_codec ? string_of_VdpCodec(obj_context->vdp_codec) : NULL));
@@ -1094,7 +2270,7 @@ vdpau_QueryConfigEntrypoints(
     VDPAU_DRIVER_DATA_INIT;
 
     VdpDecoderProfile vdp_profile = get_VdpDecoderProfile(profile);
-    if (!is_supported_profile(driver_data, vdp_profile))
+    if (!is_decodable_profile(driver_data, vdp_profile))
         return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
 
     VAEntrypoint entrypoint;
@@ -1132,16 +2308,14 @@ vdpau_QueryConfigEntrypoints(
     return VA_STATUS_SUCCESS;
 }
 
-// vaBeginPicture
-VAStatus
-vdpau_BeginPicture(
-    VADriverContextP    ctx,
-    VAContextID         context,
-    VASurfaceID         render_target
+// Starts decoding a picture into render_target
+static VAStatus
+begin_picture(
+    vdpau_driver_data_t *driver_data,
+    VAContextID          context,
+    VASurfaceID          render_target
 )
 {
-    VDPAU_DRIVER_DATA_INIT;
-
     object_context_p obj_context = VDPAU_CONTEXT(context);
     if (!obj_context)
         return VA_STATUS_ERROR_INVALID_CONTEXT;
@@ -1150,45 +2324,67 @@ vdpau_BeginPicture(
     if (!obj_surface)
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
-    obj_surface->va_surface_status           = VASurfaceRendering;
+    const vdpau_codec_ops_t * const codec_ops = obj_context->codec_ops;
+    if (!codec_ops)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    if (vdpau_capture_enabled(&driver_data->capture)) {
+        object_config_p obj_config = VDPAU_CONFIG(obj_context->config_id);
+        vdpau_capture_begin_picture(&driver_data->capture,
+                                    context,
+                                    obj_config ? obj_config->profile : -1,
+                                    obj_context->picture_width,
+                                    obj_context->picture_height);
+    }
+
+    obj_surface->pending                    |= SURFACE_PENDING_DECODE;
+    obj_surface->is_skipped                  = 0;
     obj_context->last_pic_param              = NULL;
     obj_context->last_slice_params           = NULL;
     obj_context->last_slice_params_count     = 0;
     obj_context->current_render_target       = obj_surface->base.id;
     obj_context->gen_slice_data_size         = 0;
     obj_context->vdp_bitstream_buffers_count = 0;
-
-    switch (obj_context->vdp_codec) {
-    case VDP_CODEC_MPEG1:
-    case VDP_CODEC_MPEG2:
-        obj_context->vdp_picture_info.mpeg2.slice_count = 0;
-        break;
-    case VDP_CODEC_MPEG4:
-        break;
-    case VDP_CODEC_H264:
-        obj_context->vdp_picture_info.h264.slice_count = 0;
-        break;
-    case VDP_CODEC_VC1:
-        obj_context->vdp_picture_info.vc1.slice_count = 0;
-        break;
-    default:
-        return VA_STATUS_ERROR_UNKNOWN;
-    }
+    obj_context->bitstream_arena_size        = 0;
+    if (codec_ops->begin_picture)
+        codec_ops->begin_picture(obj_context);
 
     destroy_dead_va_buffers(driver_data, obj_context);
     return VA_STATUS_SUCCESS;
 }
 
-// vaRenderPicture
+// vaBeginPicture
 VAStatus
-vdpau_RenderPicture(
+vdpau_BeginPicture(
     VADriverContextP    ctx,
     VAContextID         context,
-    VABufferID         *buffers,
-    int                 num_buffers
+    VASurfaceID         render_target
 )
 {
     VDPAU_DRIVER_DATA_INIT;
+    uint64_t start_ticks = 0;
+    VAStatus va_status;
+
+    if (stats_enabled())
+        start_ticks = get_ticks_nsec();
+
+    va_status = begin_picture(driver_data, context, render_target);
+
+    if (stats_enabled())
+        ATOMIC_ADD(&driver_data->begin_picture_ns,
+                   get_ticks_nsec() - start_ticks);
+    return va_status;
+}
+
+// Translates the VA buffers of the current picture
+static VAStatus
+render_picture(
+    vdpau_driver_data_t *driver_data,
+    VAContextID          context,
+    VABufferID          *buffers,
+    int                  num_buffers
+)
+{
     int i;
 
     object_context_p obj_context = VDPAU_CONTEXT(context);
@@ -1200,15 +2396,30 @@ vdpau_RenderPicture(
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
     /* Verify that we got valid buffer references */
-    for (i = 0; i < num_buffers; i++) {
-        object_buffer_p obj_buffer = VDPAU_BUFFER(buffers[i]);
-        if (!obj_buffer)
-            return VA_STATUS_ERROR_INVALID_BUFFER;
-    }
+    object_buffer_p *obj_buffers = realloc_buffer(
+        (void **)&obj_context->render_buffers,
+        &obj_context->render_buffers_count_max,
+        num_buffers,
+        sizeof(*obj_buffers)
+    );
+    if (!obj_buffers)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    if (object_heap_lookup_many(&driver_data->buffer_heap,
+                                (const int *)buffers, num_buffers,
+                                (object_base_p *)obj_buffers) < 0)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
 
     /* Translate buffers */
     for (i = 0; i < num_buffers; i++) {
-        object_buffer_p obj_buffer = VDPAU_BUFFER(buffers[i]);
+        object_buffer_p obj_buffer = obj_buffers[i];
+        if (vdpau_capture_enabled(&driver_data->capture))
+            vdpau_capture_va_buffer(&driver_data->capture,
+                                    context,
+                                    obj_buffer->type,
+                                    obj_buffer->num_elements,
+                                    obj_buffer->buffer_data,
+                                    obj_buffer->buffer_size);
         if (!translate_buffer(driver_data, obj_context, obj_buffer))
             return VA_STATUS_ERROR_UNSUPPORTED_BUFFERTYPE;
         /* Release any buffer that is not VASliceDataBuffer */
@@ -1220,29 +2431,55 @@ vdpau_RenderPicture(
             break;
         case VAPictureParameterBufferType:
             /* Preserve VAPictureParameterBufferMPEG4 */
-            if (obj_context->vdp_codec == VDP_CODEC_MPEG4) {
+            if (obj_context->codec_ops->preserve_pic_param) {
                 schedule_destroy_va_buffer(driver_data, obj_buffer);
                 break;
             }
             /* fall-through */
         default:
-            destroy_va_buffer(driver_data, obj_buffer);
+            recycle_va_buffer(driver_data, obj_context, obj_buffer);
             break;
         }
         buffers[i] = VA_INVALID_BUFFER;
     }
 
+    if (stats_enabled())
+        ATOMIC_ADD(&driver_data->render_picture_buffers, num_buffers);
     return VA_STATUS_SUCCESS;
 }
 
-// vaEndPicture
+// vaRenderPicture
 VAStatus
-vdpau_EndPicture(
+vdpau_RenderPicture(
     VADriverContextP    ctx,
-    VAContextID         context
+    VAContextID         context,
+    VABufferID         *buffers,
+    int                 num_buffers
 )
 {
     VDPAU_DRIVER_DATA_INIT;
+    uint64_t start_ticks = 0;
+    VAStatus va_status;
+
+    if (stats_enabled())
+        start_ticks = get_ticks_nsec();
+
+    va_status = render_picture(driver_data, context, buffers, num_buffers);
+
+    if (stats_enabled())
+        ATOMIC_ADD(&driver_data->render_picture_ns,
+                   get_ticks_nsec() - start_ticks);
+    return va_status;
+}
+
+// Submits the current picture for decoding
+static VAStatus
+end_picture(
+    vdpau_driver_data_t *driver_data,
+    VAContextID          context
+)
+{
+    uint64_t start_ticks = 0;
     unsigned int i;
 
     object_context_p obj_context = VDPAU_CONTEXT(context);
@@ -1254,29 +2491,25 @@ vdpau_EndPicture(
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
     if (trace_enabled()) {
-        switch (obj_context->vdp_codec) {
-        case VDP_CODEC_MPEG1:
-        case VDP_CODEC_MPEG2:
-            dump_VdpPictureInfoMPEG1Or2(&obj_context->vdp_picture_info.mpeg2);
-            break;
-#if HAVE_VDPAU_MPEG4
-        case VDP_CODEC_MPEG4:
-            dump_VdpPictureInfoMPEG4Part2(&obj_context->vdp_picture_info.mpeg4);
-            break;
-#endif
-        case VDP_CODEC_H264:
-            dump_VdpPictureInfoH264(&obj_context->vdp_picture_info.h264);
-            break;
-        case VDP_CODEC_VC1:
-            dump_VdpPictureInfoVC1(&obj_context->vdp_picture_info.vc1);
-            break;
-        default:
-            break;
-        }
+        if (obj_context->codec_ops->dump_picture_info)
+            obj_context->codec_ops->dump_picture_info(obj_context);
         for (i = 0; i < obj_context->vdp_bitstream_buffers_count; i++)
             dump_VdpBitstreamBuffer(&obj_context->vdp_bitstream_buffers[i]);
     }
 
+    /* The surface keeps its previous contents and reports VASurfaceSkipped */
+    if (decode_policy_skips_picture(obj_context)) {
+        ATOMIC_ADD(&driver_data->skipped_pictures, 1);
+        if (vdpau_capture_enabled(&driver_data->capture))
+            vdpau_capture_end_picture(&driver_data->capture);
+        obj_surface->is_skipped             = 1;
+        obj_surface->pending               &= ~SURFACE_PENDING_DECODE;
+        obj_context->current_render_target  = VA_INVALID_SURFACE;
+        update_bitstream_arena(obj_context);
+        destroy_dead_va_buffers(driver_data, obj_context);
+        return VA_STATUS_SUCCESS;
+    }
+
     VAStatus va_status;
     VdpStatus vdp_status;
     vdp_status = ensure_decoder_with_max_refs(
@@ -1284,7 +2517,23 @@ vdpau_EndPicture(
         obj_context,
         get_num_ref_frames(obj_context)
     );
-    if (vdp_status == VDP_STATUS_OK)
+    if (vdp_status == VDP_STATUS_OK &&
+        vdpau_capture_enabled(&driver_data->capture))
+        vdpau_capture_decode(
+            &driver_data->capture,
+            obj_context->vdp_profile,
+            obj_context->picture_width,
+            obj_context->picture_height,
+            &obj_context->vdp_picture_info,
+            sizeof(obj_context->vdp_picture_info),
+            obj_context->vdp_bitstream_buffers,
+            obj_context->vdp_bitstream_buffers_count
+        );
+    if (stats_enabled())
+        start_ticks = get_ticks_nsec();
+    if (vdp_status == VDP_STATUS_OK && obj_context->async_queue)
+        vdp_status = async_decode_submit(driver_data, obj_context, obj_surface);
+    else if (vdp_status == VDP_STATUS_OK)
         vdp_status = vdpau_decoder_render(
             driver_data,
             obj_context->vdp_decoder,
@@ -1293,13 +2542,51 @@ vdpau_EndPicture(
             obj_context->vdp_bitstream_buffers_count,
             obj_context->vdp_bitstream_buffers
         );
+    /* Queued pictures get their status when the decode thread submits them */
+    if (!obj_context->async_queue || vdp_status != VDP_STATUS_OK)
+        obj_surface->decode_status = vdp_status;
     va_status = vdpau_get_VAStatus(vdp_status);
+    if (vdp_status == VDP_STATUS_OK)
+        vdpau_sched_picture(&driver_data->sched, &obj_context->sched_session);
+    if (stats_enabled()) {
+        ATOMIC_ADD(&driver_data->decoder_render_ns,
+                   get_ticks_nsec() - start_ticks);
+        ATOMIC_ADD(&driver_data->decoded_pictures, 1);
+    }
+    if (vdpau_capture_enabled(&driver_data->capture))
+        vdpau_capture_end_picture(&driver_data->capture);
 
-    /* XXX: assume we are done with rendering right away */
+    /* A synchronous submission is complete as far as VA is concerned,
+       VDPAU orders further uses of the surface after the decode */
     obj_context->current_render_target = VA_INVALID_SURFACE;
+    if (!obj_context->async_queue || vdp_status != VDP_STATUS_OK)
+        obj_surface->pending &= ~SURFACE_PENDING_DECODE;
+    update_bitstream_arena(obj_context);
 
     /* Release pending buffers */
     destroy_dead_va_buffers(driver_data, obj_context);
 
     return va_status;
 }
+
+// vaEndPicture
+VAStatus
+vdpau_EndPicture(
+    VADriverContextP    ctx,
+    VAContextID         context
+)
+{
+    VDPAU_DRIVER_DATA_INIT;
+    uint64_t start_ticks = 0;
+    VAStatus va_status;
+
+    if (stats_enabled())
+        start_ticks = get_ticks_nsec();
+
+    va_status = end_picture(driver_data, context);
+
+    if (stats_enabled())
+        ATOMIC_ADD(&driver_data->end_picture_ns,
+                   get_ticks_nsec() - start_ticks);
+    return va_status;
+}
@@ -31,14 +31,60 @@ typedef enum {
     VDP_CODEC_VC1
 } VdpCodec;
 
+typedef struct vdpau_codec_ops vdpau_codec_ops_t;
+
+/* Pictures dropped at vaEndPicture() without being decoded. Reference
+   pictures are only dropped in keyframe mode, where they are never used */
+typedef enum {
+    VDP_DECODE_POLICY_ALL = 0,
+    VDP_DECODE_POLICY_SKIP_NON_REFERENCE,   /* non-reference pictures */
+    VDP_DECODE_POLICY_KEYFRAMES,            /* all but intra pictures */
+    VDP_DECODE_POLICY_EVERY_NTH             /* non-reference pictures but every Nth */
+} VdpDecodePolicy;
+
+/* Driver specific vaCreateConfig() attribute selecting the decode policy.
+   The value is the policy, plus N << 8 for VDP_DECODE_POLICY_EVERY_NTH */
+#define VDPAU_CONFIG_ATTRIB_DECODE_POLICY \
+    ((VAConfigAttribType)0x56440001)
+
+// Checks the value of a VDPAU_CONFIG_ATTRIB_DECODE_POLICY attribute
+VAStatus
+check_decode_policy(uint32_t value)
+    attribute_hidden;
+
+// Sets the decode policy of the context from its config or the environment
+void
+decode_policy_init(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
+// Dumps how many pictures the decode policies dropped
+void
+decode_policy_dump_statistics(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
 // Translates VdpDecoderProfile to VdpCodec
 VdpCodec get_VdpCodec(VdpDecoderProfile profile)
     attribute_hidden;
 
+// Returns the decoding hooks for the codec
+const vdpau_codec_ops_t *get_codec_ops(VdpCodec codec)
+    attribute_hidden;
+
 // Translates VAProfile to VdpDecoderProfile
 VdpDecoderProfile get_VdpDecoderProfile(VAProfile profile)
     attribute_hidden;
 
+// Returns the VDPAU profile to decode streams of that profile and size with
+VdpDecoderProfile
+get_decoder_profile(
+    vdpau_driver_data_t *driver_data,
+    VdpDecoderProfile    profile,
+    uint32_t             width,
+    uint32_t             height
+) attribute_hidden;
+
 // Checks decoder for profile/entrypoint is available
 VAStatus
 check_decoder(
@@ -47,6 +93,109 @@ check_decoder(
     VAEntrypoint         entrypoint
 ) attribute_hidden;
 
+// Builds the render targets to VDPAU surfaces map of the context
+// Returns 0 on success, -1 on error
+int
+surface_map_init(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
+// Destroys the render targets to VDPAU surfaces map of the context
+void
+surface_map_exit(object_context_p obj_context)
+    attribute_hidden;
+
+// Drops the surface from the map of the context it is bound to
+void
+surface_map_remove(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+) attribute_hidden;
+
+// Starts the decode submission thread of the context, if enabled
+// Returns 0 on success, -1 on error
+int
+async_decode_init(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
+// Flushes pending jobs and stops the decode submission thread
+void
+async_decode_exit(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
+// Checks whether the surface still has a decode job in flight
+int
+async_decode_is_pending(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+) attribute_hidden;
+
+// Returns the status of the last completed decode into the surface
+VAStatus
+async_decode_get_status(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+) attribute_hidden;
+
+// Waits for the last decode job targetting the surface to be submitted
+VAStatus
+async_decode_sync(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+) attribute_hidden;
+
+// Initializes the pool of idle VDPAU decoders
+void
+decoder_pool_init(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
+// Destroys all idle VDPAU decoders
+void
+decoder_pool_exit(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
+// Destroys all idle VDPAU decoders, returns how many were destroyed
+unsigned int
+decoder_pool_flush(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
+// Dumps decoder pool hit and miss counters
+void
+decoder_pool_dump_statistics(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
+// Dumps the time spent per picture in the decode entry points
+void
+decode_dump_statistics(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
+// Dumps how often parameter buffers matched the last translated ones
+void
+picture_info_dump_statistics(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
+// Attaches an idle decoder compatible with the context, if any. A
+// negative max_ref_frames selects the default for the profile and size
+// Returns 0 on success, -1 if no such decoder is available
+int
+decoder_pool_acquire(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context,
+    int                  max_ref_frames
+) attribute_hidden;
+
+// Detaches the decoder from the context and keeps it for later reuse
+void
+decoder_pool_release(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
 // vaQueryConfigProfiles
 VAStatus
 vdpau_QueryConfigProfiles(
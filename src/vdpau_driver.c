@@ -26,6 +26,7 @@
 #include "vdpau_image.h"
 #include "vdpau_subpic.h"
 #include "vdpau_mixer.h"
+#include "vdpau_mock.h"
 #include "vdpau_video.h"
 #include "vdpau_video_x11.h"
 #if USE_GLX
@@ -100,6 +101,15 @@ static void destroy_buffer_cb(object_base_p obj, void *user_data)
     destroy_va_buffer(driver_data, obj_buffer);
 }
 
+// Destroy CONTEXT objects
+static void destroy_context_cb(object_base_p obj, void *user_data)
+{
+    object_context_p const obj_context = (object_context_p)obj;
+    vdpau_driver_data_t * const driver_data = user_data;
+
+    destroy_context(driver_data, obj_context);
+}
+
 // Destroy MIXER objects
 static void destroy_mixer_cb(object_base_p obj, void *user_data)
 {
@@ -152,21 +162,44 @@ destroy_heap(
             return VA_STATUS_ERROR_UNKNOWN;     \
     } while (0)
 
+// Dump driver statistics
+static void
+vdpau_dump_statistics(vdpau_driver_data_t *driver_data)
+{
+    buffer_pool_dump_statistics(&driver_data->buffer_pool, "buffer pool");
+    sync_surface_dump_statistics(driver_data);
+    decoder_pool_dump_statistics(driver_data);
+    decode_dump_statistics(driver_data);
+    decode_policy_dump_statistics(driver_data);
+    picture_info_dump_statistics(driver_data);
+    vdpau_sched_dump_statistics(&driver_data->sched);
+}
+
 // vaTerminate
 static void
 vdpau_common_Terminate(vdpau_driver_data_t *driver_data)
 {
+    if (stats_enabled())
+        vdpau_dump_statistics(driver_data);
+
+    /* Contexts go first: their decode threads may still use surfaces
+       and buffers, and their teardown releases buffers they own */
+    DESTROY_HEAP(context,     destroy_context_cb);
     DESTROY_HEAP(buffer,      destroy_buffer_cb);
     DESTROY_HEAP(image,       NULL);
     DESTROY_HEAP(subpicture,  NULL);
     DESTROY_HEAP(output,      NULL);
     DESTROY_HEAP(surface,     NULL);
-    DESTROY_HEAP(context,     NULL);
     DESTROY_HEAP(config,      NULL);
     DESTROY_HEAP(mixer,       destroy_mixer_cb);
 #if USE_GLX
     DESTROY_HEAP(glx_surface, NULL);
 #endif
+    decoder_pool_exit(driver_data);
+    buffer_pool_destroy(&driver_data->buffer_pool);
+    vdpau_caps_exit(&driver_data->caps);
+    vdpau_capture_exit(&driver_data->capture);
+    vdpau_sched_exit(&driver_data->sched);
 
     if (driver_data->vdp_device != VDP_INVALID_HANDLE) {
         vdpau_device_destroy(driver_data, driver_data->vdp_device);
@@ -180,24 +213,39 @@ vdpau_common_Terminate(vdpau_driver_data_t *driver_data)
     }
 }
 
+// Give up idle decoders when they keep the scheduler from admitting a session
+static unsigned int reclaim_pooled_decoders(void *data)
+{
+    return decoder_pool_flush(data);
+}
+
 // vaInitialize
 static VAStatus
 vdpau_common_Initialize(vdpau_driver_data_t *driver_data)
 {
-    /* Create a dedicated X11 display for VDPAU purposes */
-    const char * const x11_dpy_name = XDisplayString(driver_data->x11_dpy);
-    driver_data->vdp_dpy = XOpenDisplay(x11_dpy_name);
-    if (!driver_data->vdp_dpy)
-        return VA_STATUS_ERROR_UNKNOWN;
-
     VdpStatus vdp_status;
     driver_data->vdp_device = VDP_INVALID_HANDLE;
-    vdp_status = vdp_device_create_x11(
-        driver_data->vdp_dpy,
-        driver_data->x11_screen,
-        &driver_data->vdp_device,
-        &driver_data->vdp_get_proc_address
-    );
+    if (vdpau_mock_enabled()) {
+        /* Use the software device, no GPU or X server needed */
+        vdp_status = vdpau_mock_device_create(
+            &driver_data->vdp_device,
+            &driver_data->vdp_get_proc_address
+        );
+    }
+    else {
+        /* Create a dedicated X11 display for VDPAU purposes */
+        const char * const x11_dpy_name = XDisplayString(driver_data->x11_dpy);
+        driver_data->vdp_dpy = XOpenDisplay(x11_dpy_name);
+        if (!driver_data->vdp_dpy)
+            return VA_STATUS_ERROR_UNKNOWN;
+
+        vdp_status = vdp_device_create_x11(
+            driver_data->vdp_dpy,
+            driver_data->x11_screen,
+            &driver_data->vdp_device,
+            &driver_data->vdp_get_proc_address
+        );
+    }
     if (vdp_status != VDP_STATUS_OK)
         return VA_STATUS_ERROR_UNKNOWN;
 
@@ -249,6 +297,15 @@ vdpau_common_Initialize(vdpau_driver_data_t *driver_data)
         sprintf(&driver_data->va_vendor[len], ".pre%d", VDPAU_VIDEO_PRE_VERSION);
     }
 
+    vdpau_caps_init(&driver_data->caps);
+    vdpau_caps_load(&driver_data->caps, impl_string, api_version);
+
+    if (buffer_pool_init(&driver_data->buffer_pool) < 0)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    decoder_pool_init(driver_data);
+    vdpau_capture_init(&driver_data->capture);
+    vdpau_sched_init(&driver_data->sched, reclaim_pooled_decoders, driver_data);
+
     CREATE_HEAP(config,         CONFIG);
     CREATE_HEAP(context,        CONTEXT);
     CREATE_HEAP(surface,        SURFACE);
@@ -25,6 +25,10 @@
 #include "vaapi_compat.h"
 #include "vdpau_gate.h"
 #include "object_heap.h"
+#include "buffer_pool.h"
+#include "vdpau_caps.h"
+#include "vdpau_capture.h"
+#include "vdpau_sched.h"
 
 
 #define VDPAU_DRIVER_DATA_INIT                           \
@@ -44,15 +48,15 @@
 #define VDPAU_SUBPICTURE(id)            VDPAU_OBJECT(id, subpicture)
 #define VDPAU_MIXER(id)                 VDPAU_OBJECT(id, mixer)
 
-#define VDPAU_CONFIG_ID_OFFSET          0x01000000
-#define VDPAU_CONTEXT_ID_OFFSET         0x02000000
-#define VDPAU_SURFACE_ID_OFFSET         0x03000000
-#define VDPAU_BUFFER_ID_OFFSET          0x04000000
-#define VDPAU_OUTPUT_ID_OFFSET          0x05000000
-#define VDPAU_IMAGE_ID_OFFSET           0x06000000
-#define VDPAU_SUBPICTURE_ID_OFFSET      0x07000000
-#define VDPAU_GLX_SURFACE_ID_OFFSET     0x08000000
-#define VDPAU_MIXER_ID_OFFSET           0x09000000
+#define VDPAU_CONFIG_ID_OFFSET          0x08000000
+#define VDPAU_CONTEXT_ID_OFFSET         0x10000000
+#define VDPAU_SURFACE_ID_OFFSET         0x18000000
+#define VDPAU_BUFFER_ID_OFFSET          0x20000000
+#define VDPAU_OUTPUT_ID_OFFSET          0x28000000
+#define VDPAU_IMAGE_ID_OFFSET           0x30000000
+#define VDPAU_SUBPICTURE_ID_OFFSET      0x38000000
+#define VDPAU_GLX_SURFACE_ID_OFFSET     0x40000000
+#define VDPAU_MIXER_ID_OFFSET           0x48000000
 
 #define VDPAU_MAX_PROFILES              12
 #define VDPAU_MAX_ENTRYPOINTS           5
@@ -62,6 +66,11 @@
 #define VDPAU_MAX_SUBPICTURE_FORMATS    6
 #define VDPAU_MAX_DISPLAY_ATTRIBUTES    6
 #define VDPAU_MAX_OUTPUT_SURFACES       2
+#define VDPAU_MAX_RECYCLED_BUFFERS      256
+#define VDPAU_BITSTREAM_ARENA_HISTORY   16
+#define VDPAU_BITSTREAM_ARENA_ALIGN     4096
+#define VDPAU_SYNC_LATENCY_BUCKETS      12
+#define VDPAU_MAX_POOLED_DECODERS       16
 #define VDPAU_STR_DRIVER_VENDOR         "Splitted-Desktop Systems"
 #define VDPAU_STR_DRIVER_NAME           "VDPAU backend for VA-API"
 
@@ -75,6 +84,16 @@ typedef enum {
     VDP_IMPLEMENTATION_NVIDIA = 1,
 } VdpImplementation;
 
+typedef struct vdpau_pooled_decoder vdpau_pooled_decoder_t;
+struct vdpau_pooled_decoder {
+    VdpDecoder                  vdp_decoder;
+    VdpDecoderProfile           vdp_profile;
+    unsigned int                width;
+    unsigned int                height;
+    int                         max_ref_frames;
+    uint64_t                    last_used;
+};
+
 typedef struct vdpau_driver_data vdpau_driver_data_t;
 struct vdpau_driver_data {
     VADriverContextP            va_context;
@@ -88,6 +107,30 @@ struct vdpau_driver_data {
     struct object_heap          image_heap;
     struct object_heap          subpicture_heap;
     struct object_heap          mixer_heap;
+    buffer_pool_t               buffer_pool;
+    vdpau_caps_t                caps;
+    vdpau_capture_t             capture;
+    vdpau_sched_t               sched;
+    pthread_mutex_t             decoder_pool_lock;
+    vdpau_pooled_decoder_t      decoder_pool[VDPAU_MAX_POOLED_DECODERS];
+    unsigned int                decoder_pool_count;
+    unsigned int                decoder_pool_count_max;
+    uint64_t                    decoder_pool_ticks;
+    uint64_t                    decoder_pool_hits;
+    uint64_t                    decoder_pool_misses;
+    uint64_t                    decoder_pool_evictions;
+    uint64_t                    decoder_recreations;
+    uint64_t                    iq_matrix_hits;
+    uint64_t                    iq_matrix_misses;
+    uint64_t                    seq_fields_hits;
+    uint64_t                    seq_fields_misses;
+    uint64_t                    decoded_pictures;
+    uint64_t                    skipped_pictures;
+    uint64_t                    render_picture_buffers;
+    uint64_t                    begin_picture_ns;
+    uint64_t                    render_picture_ns;
+    uint64_t                    end_picture_ns;
+    uint64_t                    decoder_render_ns;
     Display                    *x11_dpy;
     int                         x11_screen;
     Display                    *vdp_dpy;
@@ -100,6 +143,9 @@ struct vdpau_driver_data {
     uint64_t                    va_display_attrs_mtime[VDPAU_MAX_DISPLAY_ATTRIBUTES];
     unsigned int                va_display_attrs_count;
     char                        va_vendor[256];
+    uint64_t                    sync_latency[VDPAU_SYNC_LATENCY_BUCKETS];
+    uint64_t                    sync_blocked;
+    uint64_t                    sync_polled;
 };
 
 typedef struct object_config   *object_config_p;
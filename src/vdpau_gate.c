@@ -26,112 +26,191 @@
 #include "debug.h"
 
 
+/* VTable slot of VDPAU function */
+#define VDPAU_PROC_INDEX(func) \
+    (offsetof(vdpau_vtable_t, vdp_##func) / sizeof(void *))
+
+#define VDPAU_NUM_PROCS \
+    (offsetof(vdpau_vtable_t, vdp_proc_state) / sizeof(void *))
+
+enum {
+    VDPAU_PROC_STATE_UNRESOLVED = 0,
+    VDPAU_PROC_STATE_RESOLVED,
+    VDPAU_PROC_STATE_MISSING
+};
+
+typedef struct {
+    VdpFuncId           func_id;
+    unsigned int        index;
+    unsigned int        is_required;
+} vdpau_proc_t;
+
+/* Functions a decode-only process cannot live without. Everything
+   else is looked up the first time it is called */
+#define REQUIRED(FUNC_ID, func) \
+    { VDP_FUNC_ID_##FUNC_ID, VDPAU_PROC_INDEX(func), 1 }
+#define OPTIONAL(FUNC_ID, func) \
+    { VDP_FUNC_ID_##FUNC_ID, VDPAU_PROC_INDEX(func), 0 }
+
+static const vdpau_proc_t vdpau_procs[] = {
+    REQUIRED(DEVICE_DESTROY,
+             device_destroy),
+    OPTIONAL(GENERATE_CSC_MATRIX,
+             generate_csc_matrix),
+    REQUIRED(VIDEO_SURFACE_CREATE,
+             video_surface_create),
+    REQUIRED(VIDEO_SURFACE_DESTROY,
+             video_surface_destroy),
+    REQUIRED(VIDEO_SURFACE_GET_BITS_Y_CB_CR,
+             video_surface_get_bits_ycbcr),
+    REQUIRED(VIDEO_SURFACE_PUT_BITS_Y_CB_CR,
+             video_surface_put_bits_ycbcr),
+    OPTIONAL(OUTPUT_SURFACE_CREATE,
+             output_surface_create),
+    OPTIONAL(OUTPUT_SURFACE_DESTROY,
+             output_surface_destroy),
+    OPTIONAL(OUTPUT_SURFACE_GET_BITS_NATIVE,
+             output_surface_get_bits_native),
+    OPTIONAL(OUTPUT_SURFACE_PUT_BITS_NATIVE,
+             output_surface_put_bits_native),
+    OPTIONAL(OUTPUT_SURFACE_RENDER_BITMAP_SURFACE,
+             output_surface_render_bitmap_surface),
+    OPTIONAL(OUTPUT_SURFACE_RENDER_OUTPUT_SURFACE,
+             output_surface_render_output_surface),
+    OPTIONAL(OUTPUT_SURFACE_QUERY_PUT_BITS_INDEXED_CAPABILITIES,
+             output_surface_query_put_bits_indexed_capabilities),
+    OPTIONAL(OUTPUT_SURFACE_PUT_BITS_INDEXED,
+             output_surface_put_bits_indexed),
+    OPTIONAL(BITMAP_SURFACE_QUERY_CAPABILITIES,
+             bitmap_surface_query_capabilities),
+    OPTIONAL(BITMAP_SURFACE_CREATE,
+             bitmap_surface_create),
+    OPTIONAL(BITMAP_SURFACE_DESTROY,
+             bitmap_surface_destroy),
+    OPTIONAL(BITMAP_SURFACE_PUT_BITS_NATIVE,
+             bitmap_surface_put_bits_native),
+    OPTIONAL(VIDEO_MIXER_CREATE,
+             video_mixer_create),
+    OPTIONAL(VIDEO_MIXER_DESTROY,
+             video_mixer_destroy),
+    OPTIONAL(VIDEO_MIXER_RENDER,
+             video_mixer_render),
+    OPTIONAL(VIDEO_MIXER_QUERY_FEATURE_SUPPORT,
+             video_mixer_query_feature_support),
+    OPTIONAL(VIDEO_MIXER_GET_FEATURE_ENABLES,
+             video_mixer_get_feature_enables),
+    OPTIONAL(VIDEO_MIXER_SET_FEATURE_ENABLES,
+             video_mixer_set_feature_enables),
+    OPTIONAL(VIDEO_MIXER_QUERY_ATTRIBUTE_SUPPORT,
+             video_mixer_query_attribute_support),
+    OPTIONAL(VIDEO_MIXER_GET_ATTRIBUTE_VALUES,
+             video_mixer_get_attribute_values),
+    OPTIONAL(VIDEO_MIXER_SET_ATTRIBUTE_VALUES,
+             video_mixer_set_attribute_values),
+    OPTIONAL(PRESENTATION_QUEUE_CREATE,
+             presentation_queue_create),
+    OPTIONAL(PRESENTATION_QUEUE_DESTROY,
+             presentation_queue_destroy),
+    OPTIONAL(PRESENTATION_QUEUE_SET_BACKGROUND_COLOR,
+             presentation_queue_set_background_color),
+    OPTIONAL(PRESENTATION_QUEUE_GET_BACKGROUND_COLOR,
+             presentation_queue_get_background_color),
+    OPTIONAL(PRESENTATION_QUEUE_DISPLAY,
+             presentation_queue_display),
+    OPTIONAL(PRESENTATION_QUEUE_BLOCK_UNTIL_SURFACE_IDLE,
+             presentation_queue_block_until_surface_idle),
+    OPTIONAL(PRESENTATION_QUEUE_QUERY_SURFACE_STATUS,
+             presentation_queue_query_surface_status),
+    OPTIONAL(PRESENTATION_QUEUE_TARGET_CREATE_X11,
+             presentation_queue_target_create_x11),
+    OPTIONAL(PRESENTATION_QUEUE_TARGET_DESTROY,
+             presentation_queue_target_destroy),
+    REQUIRED(DECODER_CREATE,
+             decoder_create),
+    REQUIRED(DECODER_DESTROY,
+             decoder_destroy),
+    REQUIRED(DECODER_RENDER,
+             decoder_render),
+    REQUIRED(DECODER_QUERY_CAPABILITIES,
+             decoder_query_capabilities),
+    REQUIRED(VIDEO_SURFACE_QUERY_GET_PUT_BITS_Y_CB_CR_CAPABILITIES,
+             video_surface_query_ycbcr_caps),
+    OPTIONAL(OUTPUT_SURFACE_QUERY_GET_PUT_BITS_NATIVE_CAPABILITIES,
+             output_surface_query_rgba_caps),
+    REQUIRED(GET_API_VERSION,
+             get_api_version),
+    REQUIRED(GET_INFORMATION_STRING,
+             get_information_string),
+    REQUIRED(GET_ERROR_STRING,
+             get_error_string),
+};
+
+#undef REQUIRED
+#undef OPTIONAL
+
+// Looks up the VDPAU function for that VTable slot
+static unsigned int
+vdpau_gate_resolve_proc(vdpau_driver_data_t *driver_data, unsigned int index)
+{
+    vdpau_vtable_t * const vtable = &driver_data->vdp_vtable;
+    void ** const procs = (void **)vtable;
+    const vdpau_proc_t *proc = NULL;
+    unsigned int i, state;
+    void *func = NULL;
+
+    for (i = 0; i < ARRAY_ELEMS(vdpau_procs); i++) {
+        if (vdpau_procs[i].index == index) {
+            proc = &vdpau_procs[i];
+            break;
+        }
+    }
+    if (!proc)
+        return VDPAU_PROC_STATE_MISSING;
+
+    /* VdpGetProcAddress() always yields the same pointer, so concurrent
+       callers resolving the same slot store identical values */
+    if (driver_data->vdp_get_proc_address &&
+        driver_data->vdp_get_proc_address(driver_data->vdp_device,
+                                          proc->func_id,
+                                          &func) == VDP_STATUS_OK && func) {
+        ATOMIC_STORE(&procs[index], func);
+        state = VDPAU_PROC_STATE_RESOLVED;
+    }
+    else {
+        D(bug("VDPAU function %d is not implemented\n", proc->func_id));
+        state = VDPAU_PROC_STATE_MISSING;
+    }
+    ATOMIC_STORE(&vtable->vdp_proc_state[index], state);
+    return state;
+}
+
+// Makes sure the VDPAU function for that VTable slot is available
+static inline int
+vdpau_gate_resolve(vdpau_driver_data_t *driver_data, unsigned int index)
+{
+    unsigned int state;
+
+    state = ATOMIC_LOAD(&driver_data->vdp_vtable.vdp_proc_state[index]);
+    if (state == VDPAU_PROC_STATE_UNRESOLVED)
+        state = vdpau_gate_resolve_proc(driver_data, index);
+    return state == VDPAU_PROC_STATE_RESOLVED;
+}
+
 // Initialize VDPAU hooks
 int vdpau_gate_init(vdpau_driver_data_t *driver_data)
 {
-    VdpStatus vdp_status;
-
-#define VDP_INIT_PROC(FUNC_ID, FUNC) do {                       \
-        vdp_status = driver_data->vdp_get_proc_address          \
-            (driver_data->vdp_device,                           \
-             VDP_FUNC_ID_##FUNC_ID,                             \
-             (void *)&driver_data->vdp_vtable.vdp_##FUNC);      \
-        if (vdp_status != VDP_STATUS_OK)                        \
-            return -1;                                          \
-    } while (0)
-
-    VDP_INIT_PROC(DEVICE_DESTROY,
-                  device_destroy);
-    VDP_INIT_PROC(GENERATE_CSC_MATRIX,
-                  generate_csc_matrix);
-    VDP_INIT_PROC(VIDEO_SURFACE_CREATE,
-                  video_surface_create);
-    VDP_INIT_PROC(VIDEO_SURFACE_DESTROY,
-                  video_surface_destroy);
-    VDP_INIT_PROC(VIDEO_SURFACE_GET_BITS_Y_CB_CR,
-                  video_surface_get_bits_ycbcr);
-    VDP_INIT_PROC(VIDEO_SURFACE_PUT_BITS_Y_CB_CR,
-                  video_surface_put_bits_ycbcr);
-    VDP_INIT_PROC(OUTPUT_SURFACE_CREATE,
-                  output_surface_create);
-    VDP_INIT_PROC(OUTPUT_SURFACE_DESTROY,
-                  output_surface_destroy);
-    VDP_INIT_PROC(OUTPUT_SURFACE_GET_BITS_NATIVE,
-                  output_surface_get_bits_native);
-    VDP_INIT_PROC(OUTPUT_SURFACE_PUT_BITS_NATIVE,
-                  output_surface_put_bits_native);
-    VDP_INIT_PROC(OUTPUT_SURFACE_RENDER_BITMAP_SURFACE,
-                  output_surface_render_bitmap_surface);
-    VDP_INIT_PROC(OUTPUT_SURFACE_RENDER_OUTPUT_SURFACE,
-                  output_surface_render_output_surface);
-    VDP_INIT_PROC(OUTPUT_SURFACE_QUERY_PUT_BITS_INDEXED_CAPABILITIES,
-                  output_surface_query_put_bits_indexed_capabilities);
-    VDP_INIT_PROC(OUTPUT_SURFACE_PUT_BITS_INDEXED,
-                  output_surface_put_bits_indexed);
-    VDP_INIT_PROC(BITMAP_SURFACE_QUERY_CAPABILITIES,
-                  bitmap_surface_query_capabilities);
-    VDP_INIT_PROC(BITMAP_SURFACE_CREATE,
-                  bitmap_surface_create);
-    VDP_INIT_PROC(BITMAP_SURFACE_DESTROY,
-                  bitmap_surface_destroy);
-    VDP_INIT_PROC(BITMAP_SURFACE_PUT_BITS_NATIVE,
-                  bitmap_surface_put_bits_native);
-    VDP_INIT_PROC(VIDEO_MIXER_CREATE,
-                  video_mixer_create);
-    VDP_INIT_PROC(VIDEO_MIXER_DESTROY,
-                  video_mixer_destroy);
-    VDP_INIT_PROC(VIDEO_MIXER_RENDER,
-                  video_mixer_render);
-    VDP_INIT_PROC(VIDEO_MIXER_QUERY_FEATURE_SUPPORT,
-                  video_mixer_query_feature_support);
-    VDP_INIT_PROC(VIDEO_MIXER_GET_FEATURE_ENABLES,
-                  video_mixer_get_feature_enables);
-    VDP_INIT_PROC(VIDEO_MIXER_SET_FEATURE_ENABLES,
-                  video_mixer_set_feature_enables);
-    VDP_INIT_PROC(VIDEO_MIXER_QUERY_ATTRIBUTE_SUPPORT,
-                  video_mixer_query_attribute_support);
-    VDP_INIT_PROC(VIDEO_MIXER_GET_ATTRIBUTE_VALUES,
-                  video_mixer_get_attribute_values);
-    VDP_INIT_PROC(VIDEO_MIXER_SET_ATTRIBUTE_VALUES,
-                  video_mixer_set_attribute_values);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_CREATE,
-                  presentation_queue_create);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_DESTROY,
-                  presentation_queue_destroy);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_SET_BACKGROUND_COLOR,
-                  presentation_queue_set_background_color);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_GET_BACKGROUND_COLOR,
-                  presentation_queue_get_background_color);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_DISPLAY,
-                  presentation_queue_display);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_BLOCK_UNTIL_SURFACE_IDLE,
-                  presentation_queue_block_until_surface_idle);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_QUERY_SURFACE_STATUS,
-                  presentation_queue_query_surface_status);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_TARGET_CREATE_X11,
-                  presentation_queue_target_create_x11);
-    VDP_INIT_PROC(PRESENTATION_QUEUE_TARGET_DESTROY,
-                  presentation_queue_target_destroy);
-    VDP_INIT_PROC(DECODER_CREATE,
-                  decoder_create);
-    VDP_INIT_PROC(DECODER_DESTROY,
-                  decoder_destroy);
-    VDP_INIT_PROC(DECODER_RENDER,
-                  decoder_render);
-    VDP_INIT_PROC(DECODER_QUERY_CAPABILITIES,
-                  decoder_query_capabilities);
-    VDP_INIT_PROC(VIDEO_SURFACE_QUERY_GET_PUT_BITS_Y_CB_CR_CAPABILITIES,
-                  video_surface_query_ycbcr_caps);
-    VDP_INIT_PROC(OUTPUT_SURFACE_QUERY_GET_PUT_BITS_NATIVE_CAPABILITIES,
-                  output_surface_query_rgba_caps);
-    VDP_INIT_PROC(GET_API_VERSION,
-                  get_api_version);
-    VDP_INIT_PROC(GET_INFORMATION_STRING,
-                  get_information_string);
-    VDP_INIT_PROC(GET_ERROR_STRING,
-                  get_error_string);
-
-#undef VDP_INIT_PROC
+    unsigned int i;
+
+    if (VDPAU_NUM_PROCS > VDPAU_MAX_PROCS)
+        return -1;
+
+    memset(&driver_data->vdp_vtable, 0, sizeof(driver_data->vdp_vtable));
+    for (i = 0; i < ARRAY_ELEMS(vdpau_procs); i++) {
+        if (!vdpau_procs[i].is_required)
+            continue;
+        if (!vdpau_gate_resolve(driver_data, vdpau_procs[i].index))
+            return -1;
+    }
     return 0;
 }
 
@@ -157,13 +236,15 @@ int vdpau_check_status(
     return 1;
 }
 
-#define VDPAU_INVOKE_(retval, func, ...)               \
-    (driver_data && driver_data->vdp_vtable.vdp_##func \
-     ? driver_data->vdp_vtable.vdp_##func(__VA_ARGS__) \
-     : (retval))
+#define VDPAU_INVOKE_(retval, missing, func, ...)              \
+    (!driver_data ? (retval) :                                  \
+     vdpau_gate_resolve(driver_data, VDPAU_PROC_INDEX(func))    \
+     ? driver_data->vdp_vtable.vdp_##func(__VA_ARGS__)          \
+     : (missing))
 
-#define VDPAU_INVOKE(func, ...)                        \
-    VDPAU_INVOKE_(VDP_STATUS_INVALID_POINTER,          \
+#define VDPAU_INVOKE(func, ...)                                 \
+    VDPAU_INVOKE_(VDP_STATUS_INVALID_POINTER,                   \
+                  VDP_STATUS_NO_IMPLEMENTATION,                 \
                   func, __VA_ARGS__)
 
 // VdpGenerateCSCMatrix
@@ -897,5 +978,5 @@ vdpau_get_information_string(
 const char *
 vdpau_get_error_string(vdpau_driver_data_t *driver_data, VdpStatus vdp_status)
 {
-    return VDPAU_INVOKE_(NULL, get_error_string, vdp_status);
+    return VDPAU_INVOKE_(NULL, NULL, get_error_string, vdp_status);
 }
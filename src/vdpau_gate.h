@@ -28,7 +28,10 @@ typedef struct vdpau_vtable       vdpau_vtable_t;
 typedef struct vdpau_vtable      *vdpau_vtable_p;
 typedef struct vdpau_driver_data *vdpau_driver_data_p;
 
-// VDPAU VTable
+/* Upper bound on the number of function pointers in the VTable */
+#define VDPAU_MAX_PROCS 64
+
+// VDPAU VTable, entries are resolved on first use
 struct vdpau_vtable {
     VdpDeviceDestroy                    *vdp_device_destroy;
     VdpGenerateCSCMatrix                *vdp_generate_csc_matrix;
@@ -75,6 +78,9 @@ struct vdpau_vtable {
     VdpGetApiVersion                    *vdp_get_api_version;
     VdpGetInformationString             *vdp_get_information_string;
     VdpGetErrorString                   *vdp_get_error_string;
+
+    /* Resolution state of each function pointer above */
+    unsigned int                         vdp_proc_state[VDPAU_MAX_PROCS];
 };
 
 // Initialize VDPAU hooks
@@ -105,30 +105,15 @@ is_supported_format(
     uint32_t             format
 )
 {
-    VdpBool is_supported = VDP_FALSE;
-    VdpStatus vdp_status;
-
     switch (type) {
     case VDP_IMAGE_FORMAT_TYPE_YCBCR:
-        vdp_status =
-            vdpau_video_surface_query_ycbcr_caps(driver_data,
-                                                 driver_data->vdp_device,
-                                                 VDP_CHROMA_TYPE_420,
-                                                 format,
-                                                 &is_supported);
-        break;
+        return vdpau_caps_has_ycbcr_format(driver_data, format);
     case VDP_IMAGE_FORMAT_TYPE_RGBA:
-        vdp_status =
-            vdpau_output_surface_query_rgba_caps(driver_data,
-                                                 driver_data->vdp_device,
-                                                 format,
-                                                 &is_supported);
-        break;
+        return vdpau_caps_has_rgba_format(driver_data, format);
     default:
-        vdp_status = VDP_STATUS_INVALID_VALUE;
         break;
     }
-    return vdp_status == VDP_STATUS_OK && is_supported;
+    return VDP_FALSE;
 }
 
 // vaQueryImageFormats
@@ -406,6 +391,10 @@ get_image(
     if (!obj_buffer)
         return VA_STATUS_ERROR_INVALID_BUFFER;
 
+    VAStatus va_status = async_decode_sync(driver_data, obj_surface);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
     switch (image->format.fourcc) {
     case VA_FOURCC('I','4','2','0'):
         src[0] = (uint8_t *)obj_buffer->buffer_data + image->offsets[0];
@@ -539,6 +528,11 @@ put_image(
         return VA_STATUS_ERROR_SURFACE_BUSY;
 #endif
 
+    /* Wait for a queued decode so that it does not overwrite the image */
+    VAStatus va_status = async_decode_sync(driver_data, obj_surface);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
     /* RGBA to video surface requires color space conversion */
     if (obj_image->vdp_rgba_output_surface != VDP_INVALID_HANDLE)
         return VA_STATUS_ERROR_OPERATION_FAILED;
@@ -52,17 +52,7 @@ video_mixer_has_feature(
     VdpVideoMixerFeature feature
 )
 {
-    VdpBool is_supported = VDP_FALSE;
-    VdpStatus status;
-
-    status = vdpau_video_mixer_query_feature_support(
-        driver_data,
-        driver_data->vdp_device,
-        feature,
-        &is_supported
-    );
-    return (VDPAU_CHECK_STATUS(status, "VdpVideoMixerQueryFeatureSupport()") &&
-            is_supported);
+    return vdpau_caps_has_mixer_feature(driver_data, feature);
 }
 
 object_mixer_p
@@ -146,13 +136,20 @@ video_mixer_create_cached(
         return video_mixer_ref(driver_data, obj_mixer);
 
     object_heap_iterator iter;
-    object_base_p obj = object_heap_first(&driver_data->mixer_heap, &iter);
+    object_base_p obj;
+    object_heap_lock(&driver_data->mixer_heap);
+    obj = object_heap_first_unlocked(&driver_data->mixer_heap, &iter);
     while (obj) {
-        obj_mixer = (object_mixer_p)obj;
-        if (video_mixer_check_params(obj_mixer, obj_surface))
-            return video_mixer_ref(driver_data, obj_mixer);
-        obj = object_heap_next(&driver_data->mixer_heap, &iter);
+        object_mixer_p m = (object_mixer_p)obj;
+        if (video_mixer_check_params(m, obj_surface)) {
+            obj_mixer = video_mixer_ref(driver_data, m);
+            break;
+        }
+        obj = object_heap_next_unlocked(&driver_data->mixer_heap, &iter);
     }
+    object_heap_unlock(&driver_data->mixer_heap);
+    if (obj_mixer)
+        return obj_mixer;
     return video_mixer_create(driver_data, obj_surface);
 }
 
@@ -0,0 +1,1423 @@
+/*
+ *  vdpau_mock.c - Software VDPAU device for running without a GPU
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "sysdeps.h"
+#include "vdpau_mock.h"
+#include "utils.h"
+#include <pthread.h>
+
+#define DEBUG 1
+#include "debug.h"
+
+/*
+ * The software device keeps all surfaces in host memory. Decoding only
+ * computes a checksum of the bitstream, which is stamped into the first
+ * luma row of the target surface. The video mixer converts and scales
+ * the current field on the CPU. Presentation queues flip at most once
+ * per simulated vertical refresh, VDPAU_VIDEO_MOCK_REFRESH times per
+ * second (default: 60).
+ */
+
+#define MOCK_MAX_SIZE                   4096
+#define MOCK_DEFAULT_REFRESH            60
+
+typedef enum {
+    MOCK_OBJECT_DEVICE = 1,
+    MOCK_OBJECT_VIDEO_SURFACE,
+    MOCK_OBJECT_OUTPUT_SURFACE,
+    MOCK_OBJECT_BITMAP_SURFACE,
+    MOCK_OBJECT_DECODER,
+    MOCK_OBJECT_VIDEO_MIXER,
+    MOCK_OBJECT_PRESENTATION_QUEUE_TARGET,
+    MOCK_OBJECT_PRESENTATION_QUEUE
+} mock_object_type_t;
+
+typedef struct mock_object mock_object_t;
+struct mock_object {
+    mock_object_type_t  type;
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            format;
+    uint8_t            *data;           /* Y, U, V planes or RGBA pixels */
+    uint32_t            pitch;
+    uint32_t            checksum;
+    VdpDecoderProfile   profile;
+    uint32_t            present_queue;  /* queue the surface was last displayed on */
+    VdpTime             present_time;   /* when it becomes visible */
+    VdpTime             idle_time;      /* when the next surface replaces it, or 0 */
+    uint32_t            last_surface;   /* last surface displayed on the queue */
+    VdpTime             last_time;      /* when it becomes visible */
+    VdpColor            background;
+};
+
+static pthread_mutex_t  g_mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static mock_object_t  **g_mock_objects;
+static unsigned int     g_mock_objects_count;
+static unsigned int     g_mock_objects_count_max;
+
+// Check whether the software VDPAU device is requested
+int vdpau_mock_enabled(void)
+{
+    static int g_mock_enabled = -1;
+    if (g_mock_enabled < 0) {
+        if (getenv_yesno("VDPAU_VIDEO_MOCK", &g_mock_enabled) < 0)
+            g_mock_enabled = 0;
+    }
+    return g_mock_enabled;
+}
+
+// Returns the duration of a simulated vertical refresh, in nanoseconds
+static VdpTime mock_refresh_period(void)
+{
+    static VdpTime g_refresh_period;
+    if (!g_refresh_period) {
+        int refresh;
+        if (getenv_int("VDPAU_VIDEO_MOCK_REFRESH", &refresh) < 0 || refresh <= 0)
+            refresh = MOCK_DEFAULT_REFRESH;
+        g_refresh_period = 1000000000ULL / refresh;
+    }
+    return g_refresh_period;
+}
+
+// Registers a new object, returns its handle or VDP_INVALID_HANDLE
+static uint32_t mock_object_register(mock_object_t *obj)
+{
+    mock_object_t **objects;
+    unsigned int i;
+
+    stats_mutex_lock(&g_mock_lock);
+    for (i = 0; i < g_mock_objects_count; i++) {
+        if (!g_mock_objects[i])
+            break;
+    }
+    if (i == g_mock_objects_count) {
+        /* Grow by hand, realloc_buffer() would free the table on failure */
+        if (g_mock_objects_count == g_mock_objects_count_max) {
+            const unsigned int count_max = g_mock_objects_count_max + 16;
+            objects = realloc(g_mock_objects, count_max * sizeof(*objects));
+            if (!objects) {
+                pthread_mutex_unlock(&g_mock_lock);
+                return VDP_INVALID_HANDLE;
+            }
+            g_mock_objects           = objects;
+            g_mock_objects_count_max = count_max;
+        }
+        g_mock_objects_count++;
+    }
+    g_mock_objects[i] = obj;
+    pthread_mutex_unlock(&g_mock_lock);
+    return i + 1;
+}
+
+// Looks up an object of the given type, the mock lock must be held
+static mock_object_t *mock_object_lookup(uint32_t handle, mock_object_type_t type)
+{
+    mock_object_t *obj;
+
+    if (handle == 0 || handle > g_mock_objects_count)
+        return NULL;
+    obj = g_mock_objects[handle - 1];
+    if (!obj || obj->type != type)
+        return NULL;
+    return obj;
+}
+
+// Creates an object with pixel storage
+static VdpStatus
+mock_object_create(
+    mock_object_type_t  type,
+    uint32_t            width,
+    uint32_t            height,
+    uint32_t            format,
+    uint32_t            data_size,
+    uint32_t           *handle
+)
+{
+    mock_object_t *obj;
+
+    if (!handle)
+        return VDP_STATUS_INVALID_POINTER;
+    *handle = VDP_INVALID_HANDLE;
+
+    obj = calloc(1, sizeof(*obj));
+    if (!obj)
+        return VDP_STATUS_RESOURCES;
+    obj->type   = type;
+    obj->width  = width;
+    obj->height = height;
+    obj->format = format;
+    if (data_size > 0) {
+        obj->data = calloc(1, data_size);
+        if (!obj->data) {
+            free(obj);
+            return VDP_STATUS_RESOURCES;
+        }
+    }
+
+    *handle = mock_object_register(obj);
+    if (*handle == VDP_INVALID_HANDLE) {
+        free(obj->data);
+        free(obj);
+        return VDP_STATUS_RESOURCES;
+    }
+    return VDP_STATUS_OK;
+}
+
+// Destroys an object of the given type
+static VdpStatus mock_object_destroy(uint32_t handle, mock_object_type_t type)
+{
+    mock_object_t *obj;
+
+    stats_mutex_lock(&g_mock_lock);
+    obj = mock_object_lookup(handle, type);
+    if (obj)
+        g_mock_objects[handle - 1] = NULL;
+    pthread_mutex_unlock(&g_mock_lock);
+
+    if (!obj)
+        return VDP_STATUS_INVALID_HANDLE;
+    free(obj->data);
+    free(obj);
+    return VDP_STATUS_OK;
+}
+
+#define MOCK_LOOKUP(var, handle, TYPE) do {             \
+        stats_mutex_lock(&g_mock_lock);                 \
+        var = mock_object_lookup(handle, MOCK_OBJECT_##TYPE); \
+        if (!var) {                                     \
+            pthread_mutex_unlock(&g_mock_lock);         \
+            return VDP_STATUS_INVALID_HANDLE;           \
+        }                                               \
+    } while (0)
+
+#define MOCK_UNLOCK() pthread_mutex_unlock(&g_mock_lock)
+
+// Clips rect to a width x height surface, NULL meaning the whole surface
+static void
+mock_get_rect(const VdpRect *rect, uint32_t width, uint32_t height, VdpRect *out)
+{
+    if (rect) {
+        out->x0 = MIN(rect->x0, width);
+        out->y0 = MIN(rect->y0, height);
+        out->x1 = MIN(rect->x1, width);
+        out->y1 = MIN(rect->y1, height);
+    }
+    else {
+        out->x0 = 0;
+        out->y0 = 0;
+        out->x1 = width;
+        out->y1 = height;
+    }
+}
+
+static inline uint8_t mock_clamp(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* ====================================================================== */
+/* === Device                                                         === */
+/* ====================================================================== */
+
+static const char *mock_get_error_string(VdpStatus status)
+{
+    static const char *error_strings[] = {
+        "The operation completed successfully",
+        "No backend implementation could be loaded",
+        "The display was preempted",
+        "An invalid handle value was provided",
+        "An invalid pointer was provided",
+        "An invalid/unsupported VdpChromaType value was supplied",
+        "An invalid/unsupported VdpYCbCrFormat value was supplied",
+        "An invalid/unsupported VdpRGBAFormat value was supplied",
+        "An invalid/unsupported VdpIndexedFormat value was supplied",
+        "An invalid/unsupported VdpColorStandard value was supplied",
+        "An invalid/unsupported VdpColorTableFormat value was supplied",
+        "An invalid/unsupported VdpOutputSurfaceRenderBlendFactor value was supplied",
+        "An invalid/unsupported VdpOutputSurfaceRenderBlendEquation value was supplied",
+        "An invalid/unsupported flag value/combination was supplied",
+        "An invalid/unsupported VdpDecoderProfile value was supplied",
+        "An invalid/unsupported VdpVideoMixerFeature value was supplied",
+        "An invalid/unsupported VdpVideoMixerParameter value was supplied",
+        "An invalid/unsupported VdpVideoMixerAttribute value was supplied",
+        "An invalid/unsupported VdpVideoMixerPictureStructure value was supplied",
+        "An invalid/unsupported VdpFuncId value was supplied",
+        "The size of a supplied object does not match the object it is being used with",
+        "An invalid/unsupported value was supplied",
+        "An invalid/unsupported structure version was specified",
+        "The system does not have enough resources to complete the requested operation",
+        "The set of handles supplied are not all related to the same VdpDevice",
+        "A catch-all error, used when no other error code applies"
+    };
+
+    if ((unsigned int)status < ARRAY_ELEMS(error_strings))
+        return error_strings[status];
+    return NULL;
+}
+
+static VdpStatus mock_get_api_version(uint32_t *api_version)
+{
+    if (!api_version)
+        return VDP_STATUS_INVALID_POINTER;
+    *api_version = VDPAU_VERSION;
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus mock_get_information_string(const char **info_string)
+{
+    if (!info_string)
+        return VDP_STATUS_INVALID_POINTER;
+    *info_string = PACKAGE_NAME " software VDPAU device";
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus mock_device_destroy(VdpDevice device)
+{
+    return mock_object_destroy(device, MOCK_OBJECT_DEVICE);
+}
+
+static VdpStatus
+mock_generate_csc_matrix(
+    VdpProcamp         *procamp,
+    VdpColorStandard    standard,
+    VdpCSCMatrix       *csc_matrix
+)
+{
+    float kr, kb;
+
+    if (!csc_matrix)
+        return VDP_STATUS_INVALID_POINTER;
+
+    switch (standard) {
+    case VDP_COLOR_STANDARD_ITUR_BT_601: kr = 0.299f;  kb = 0.114f;  break;
+    case VDP_COLOR_STANDARD_ITUR_BT_709: kr = 0.2126f; kb = 0.0722f; break;
+    case VDP_COLOR_STANDARD_SMPTE_240M:  kr = 0.212f;  kb = 0.087f;  break;
+    default: return VDP_STATUS_INVALID_COLOR_STANDARD;
+    }
+
+    /* Procamp adjustments are not simulated */
+    const float kg = 1.0f - kr - kb;
+    (*csc_matrix)[0][0] = 1.0f;
+    (*csc_matrix)[0][1] = 0.0f;
+    (*csc_matrix)[0][2] = 2.0f * (1.0f - kr);
+    (*csc_matrix)[0][3] = -(1.0f - kr);
+    (*csc_matrix)[1][0] = 1.0f;
+    (*csc_matrix)[1][1] = -2.0f * (1.0f - kb) * kb / kg;
+    (*csc_matrix)[1][2] = -2.0f * (1.0f - kr) * kr / kg;
+    (*csc_matrix)[1][3] = (1.0f - kb) * kb / kg + (1.0f - kr) * kr / kg;
+    (*csc_matrix)[2][0] = 1.0f;
+    (*csc_matrix)[2][1] = 2.0f * (1.0f - kb);
+    (*csc_matrix)[2][2] = 0.0f;
+    (*csc_matrix)[2][3] = -(1.0f - kb);
+    return VDP_STATUS_OK;
+}
+
+/* ====================================================================== */
+/* === Video surfaces                                                 === */
+/* ====================================================================== */
+
+/* Video surfaces are stored as 4:2:0 planar Y, U, V */
+#define VIDEO_SURFACE_Y(obj)    ((obj)->data)
+#define VIDEO_SURFACE_U(obj)    ((obj)->data + (obj)->width * (obj)->height)
+#define VIDEO_SURFACE_V(obj)    (VIDEO_SURFACE_U(obj) + ((obj)->width / 2) * ((obj)->height / 2))
+
+static VdpStatus
+mock_video_surface_query_ycbcr_caps(
+    VdpDevice           device,
+    VdpChromaType       chroma_type,
+    VdpYCbCrFormat      format,
+    VdpBool            *is_supported
+)
+{
+    if (!is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+    *is_supported = (chroma_type == VDP_CHROMA_TYPE_420 &&
+                     (format == VDP_YCBCR_FORMAT_NV12 ||
+                      format == VDP_YCBCR_FORMAT_YV12));
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_surface_create(
+    VdpDevice           device,
+    VdpChromaType       chroma_type,
+    uint32_t            width,
+    uint32_t            height,
+    VdpVideoSurface    *surface
+)
+{
+    if (chroma_type != VDP_CHROMA_TYPE_420)
+        return VDP_STATUS_INVALID_CHROMA_TYPE;
+    if (width == 0 || height == 0 || width > MOCK_MAX_SIZE || height > MOCK_MAX_SIZE)
+        return VDP_STATUS_INVALID_SIZE;
+
+    width  = (width  + 1) & -2;
+    height = (height + 1) & -2;
+    return mock_object_create(MOCK_OBJECT_VIDEO_SURFACE, width, height,
+                              chroma_type, width * height * 3 / 2, surface);
+}
+
+static VdpStatus mock_video_surface_destroy(VdpVideoSurface surface)
+{
+    return mock_object_destroy(surface, MOCK_OBJECT_VIDEO_SURFACE);
+}
+
+// Copies a plane of width x height bytes between pitched buffers
+static void
+mock_copy_plane(
+    uint8_t            *dst,
+    uint32_t            dst_pitch,
+    const uint8_t      *src,
+    uint32_t            src_pitch,
+    uint32_t            width,
+    uint32_t            height
+)
+{
+    uint32_t y;
+
+    for (y = 0; y < height; y++)
+        memcpy(dst + y * dst_pitch, src + y * src_pitch, width);
+}
+
+static VdpStatus
+mock_video_surface_get_bits_ycbcr(
+    VdpVideoSurface     surface,
+    VdpYCbCrFormat      format,
+    void * const       *dst,
+    const uint32_t     *dst_pitches
+)
+{
+    mock_object_t *obj;
+    uint32_t x, y, w, h;
+
+    if (!dst || !dst_pitches)
+        return VDP_STATUS_INVALID_POINTER;
+
+    MOCK_LOOKUP(obj, surface, VIDEO_SURFACE);
+    w = obj->width;
+    h = obj->height;
+    switch (format) {
+    case VDP_YCBCR_FORMAT_NV12:
+        mock_copy_plane(dst[0], dst_pitches[0], VIDEO_SURFACE_Y(obj), w, w, h);
+        for (y = 0; y < h / 2; y++) {
+            uint8_t * const uv = (uint8_t *)dst[1] + y * dst_pitches[1];
+            const uint8_t * const u = VIDEO_SURFACE_U(obj) + y * (w / 2);
+            const uint8_t * const v = VIDEO_SURFACE_V(obj) + y * (w / 2);
+            for (x = 0; x < w / 2; x++) {
+                uv[2 * x + 0] = u[x];
+                uv[2 * x + 1] = v[x];
+            }
+        }
+        break;
+    case VDP_YCBCR_FORMAT_YV12:
+        mock_copy_plane(dst[0], dst_pitches[0], VIDEO_SURFACE_Y(obj), w, w, h);
+        mock_copy_plane(dst[1], dst_pitches[1], VIDEO_SURFACE_V(obj), w / 2, w / 2, h / 2);
+        mock_copy_plane(dst[2], dst_pitches[2], VIDEO_SURFACE_U(obj), w / 2, w / 2, h / 2);
+        break;
+    default:
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+    }
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_surface_put_bits_ycbcr(
+    VdpVideoSurface     surface,
+    VdpYCbCrFormat      format,
+    const void * const *src,
+    const uint32_t     *src_pitches
+)
+{
+    mock_object_t *obj;
+    uint32_t x, y, w, h;
+
+    if (!src || !src_pitches)
+        return VDP_STATUS_INVALID_POINTER;
+
+    MOCK_LOOKUP(obj, surface, VIDEO_SURFACE);
+    w = obj->width;
+    h = obj->height;
+    switch (format) {
+    case VDP_YCBCR_FORMAT_NV12:
+        mock_copy_plane(VIDEO_SURFACE_Y(obj), w, src[0], src_pitches[0], w, h);
+        for (y = 0; y < h / 2; y++) {
+            const uint8_t * const uv = (const uint8_t *)src[1] + y * src_pitches[1];
+            uint8_t * const u = VIDEO_SURFACE_U(obj) + y * (w / 2);
+            uint8_t * const v = VIDEO_SURFACE_V(obj) + y * (w / 2);
+            for (x = 0; x < w / 2; x++) {
+                u[x] = uv[2 * x + 0];
+                v[x] = uv[2 * x + 1];
+            }
+        }
+        break;
+    case VDP_YCBCR_FORMAT_YV12:
+        mock_copy_plane(VIDEO_SURFACE_Y(obj), w, src[0], src_pitches[0], w, h);
+        mock_copy_plane(VIDEO_SURFACE_V(obj), w / 2, src[1], src_pitches[1], w / 2, h / 2);
+        mock_copy_plane(VIDEO_SURFACE_U(obj), w / 2, src[2], src_pitches[2], w / 2, h / 2);
+        break;
+    default:
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+    }
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+/* ====================================================================== */
+/* === Output and bitmap surfaces                                     === */
+/* ====================================================================== */
+
+/* Output and bitmap surfaces are stored as 32-bit pixels in their
+   native format, only 8-bit per component formats are supported */
+static inline int mock_is_rgba_format(VdpRGBAFormat format)
+{
+    return (format == VDP_RGBA_FORMAT_B8G8R8A8 ||
+            format == VDP_RGBA_FORMAT_R8G8B8A8);
+}
+
+static VdpStatus
+mock_rgba_surface_create(
+    mock_object_type_t  type,
+    VdpRGBAFormat       format,
+    uint32_t            width,
+    uint32_t            height,
+    uint32_t           *surface
+)
+{
+    if (!mock_is_rgba_format(format))
+        return VDP_STATUS_INVALID_RGBA_FORMAT;
+    if (width == 0 || height == 0 || width > MOCK_MAX_SIZE || height > MOCK_MAX_SIZE)
+        return VDP_STATUS_INVALID_SIZE;
+    return mock_object_create(type, width, height, format,
+                              width * height * 4, surface);
+}
+
+static VdpStatus
+mock_output_surface_query_rgba_caps(
+    VdpDevice           device,
+    VdpRGBAFormat       format,
+    VdpBool            *is_supported
+)
+{
+    if (!is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+    *is_supported = mock_is_rgba_format(format);
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_output_surface_query_put_bits_indexed_capabilities(
+    VdpDevice           device,
+    VdpRGBAFormat       format,
+    VdpIndexedFormat    bits_format,
+    VdpColorTableFormat color_table_format,
+    VdpBool            *is_supported
+)
+{
+    if (!is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+    *is_supported = (mock_is_rgba_format(format) &&
+                     color_table_format == VDP_COLOR_TABLE_FORMAT_B8G8R8X8 &&
+                     (bits_format == VDP_INDEXED_FORMAT_A4I4 ||
+                      bits_format == VDP_INDEXED_FORMAT_I4A4 ||
+                      bits_format == VDP_INDEXED_FORMAT_A8I8 ||
+                      bits_format == VDP_INDEXED_FORMAT_I8A8));
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_output_surface_create(
+    VdpDevice           device,
+    VdpRGBAFormat       format,
+    uint32_t            width,
+    uint32_t            height,
+    VdpOutputSurface   *surface
+)
+{
+    return mock_rgba_surface_create(MOCK_OBJECT_OUTPUT_SURFACE,
+                                    format, width, height, surface);
+}
+
+static VdpStatus mock_output_surface_destroy(VdpOutputSurface surface)
+{
+    return mock_object_destroy(surface, MOCK_OBJECT_OUTPUT_SURFACE);
+}
+
+static VdpStatus
+mock_output_surface_get_bits_native(
+    VdpOutputSurface    surface,
+    const VdpRect      *src_rect,
+    void * const       *dst,
+    const uint32_t     *dst_pitches
+)
+{
+    mock_object_t *obj;
+    VdpRect rect;
+
+    if (!dst || !dst_pitches)
+        return VDP_STATUS_INVALID_POINTER;
+
+    MOCK_LOOKUP(obj, surface, OUTPUT_SURFACE);
+    mock_get_rect(src_rect, obj->width, obj->height, &rect);
+    if (rect.x1 > rect.x0 && rect.y1 > rect.y0)
+        mock_copy_plane(dst[0], dst_pitches[0],
+                        obj->data + (rect.y0 * obj->width + rect.x0) * 4,
+                        obj->width * 4,
+                        (rect.x1 - rect.x0) * 4, rect.y1 - rect.y0);
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+// Copies native pixels into a rectangle of an output or bitmap surface
+static VdpStatus
+mock_rgba_surface_put_bits(
+    uint32_t            surface,
+    mock_object_type_t  type,
+    const void * const *src,
+    const uint32_t     *src_pitches,
+    const VdpRect      *dst_rect
+)
+{
+    mock_object_t *obj;
+    VdpRect rect;
+
+    if (!src || !src_pitches)
+        return VDP_STATUS_INVALID_POINTER;
+
+    stats_mutex_lock(&g_mock_lock);
+    obj = mock_object_lookup(surface, type);
+    if (!obj) {
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+    mock_get_rect(dst_rect, obj->width, obj->height, &rect);
+    if (rect.x1 > rect.x0 && rect.y1 > rect.y0)
+        mock_copy_plane(obj->data + (rect.y0 * obj->width + rect.x0) * 4,
+                        obj->width * 4,
+                        src[0], src_pitches[0],
+                        (rect.x1 - rect.x0) * 4, rect.y1 - rect.y0);
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_output_surface_put_bits_native(
+    VdpOutputSurface    surface,
+    const void * const *src,
+    const uint32_t     *src_pitches,
+    const VdpRect      *dst_rect
+)
+{
+    return mock_rgba_surface_put_bits(surface, MOCK_OBJECT_OUTPUT_SURFACE,
+                                      src, src_pitches, dst_rect);
+}
+
+static VdpStatus
+mock_output_surface_put_bits_indexed(
+    VdpOutputSurface    surface,
+    VdpIndexedFormat    format,
+    const void * const *src,
+    const uint32_t     *src_pitches,
+    const VdpRect      *dst_rect,
+    VdpColorTableFormat color_table_format,
+    const void         *color_table
+)
+{
+    const uint8_t *palette = color_table;
+    mock_object_t *obj;
+    uint32_t x, y;
+    VdpRect rect;
+
+    if (!src || !src_pitches || !color_table)
+        return VDP_STATUS_INVALID_POINTER;
+    if (color_table_format != VDP_COLOR_TABLE_FORMAT_B8G8R8X8)
+        return VDP_STATUS_INVALID_COLOR_TABLE_FORMAT;
+
+    MOCK_LOOKUP(obj, surface, OUTPUT_SURFACE);
+    mock_get_rect(dst_rect, obj->width, obj->height, &rect);
+    for (y = rect.y0; y < rect.y1; y++) {
+        const uint8_t * const s = (const uint8_t *)src[0] + (y - rect.y0) * src_pitches[0];
+        uint8_t * const d = obj->data + y * obj->width * 4;
+        for (x = rect.x0; x < rect.x1; x++) {
+            unsigned int i, a;
+            switch (format) {
+            case VDP_INDEXED_FORMAT_A4I4:
+                i = s[x - rect.x0] & 0x0f;
+                a = (s[x - rect.x0] >> 4) * 0x11;
+                break;
+            case VDP_INDEXED_FORMAT_I4A4:
+                i = s[x - rect.x0] >> 4;
+                a = (s[x - rect.x0] & 0x0f) * 0x11;
+                break;
+            case VDP_INDEXED_FORMAT_A8I8:
+                i = s[2 * (x - rect.x0) + 0];
+                a = s[2 * (x - rect.x0) + 1];
+                break;
+            case VDP_INDEXED_FORMAT_I8A8:
+                i = s[2 * (x - rect.x0) + 1];
+                a = s[2 * (x - rect.x0) + 0];
+                break;
+            default:
+                MOCK_UNLOCK();
+                return VDP_STATUS_INVALID_INDEXED_FORMAT;
+            }
+            d[4 * x + 0] = palette[4 * i + 0];
+            d[4 * x + 1] = palette[4 * i + 1];
+            d[4 * x + 2] = palette[4 * i + 2];
+            d[4 * x + 3] = a;
+        }
+    }
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_bitmap_surface_query_capabilities(
+    VdpDevice           device,
+    VdpRGBAFormat       format,
+    VdpBool            *is_supported,
+    uint32_t           *max_width,
+    uint32_t           *max_height
+)
+{
+    if (!is_supported || !max_width || !max_height)
+        return VDP_STATUS_INVALID_POINTER;
+    *is_supported = mock_is_rgba_format(format);
+    *max_width    = MOCK_MAX_SIZE;
+    *max_height   = MOCK_MAX_SIZE;
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_bitmap_surface_create(
+    VdpDevice           device,
+    VdpRGBAFormat       format,
+    uint32_t            width,
+    uint32_t            height,
+    VdpBool             frequently_accessed,
+    VdpBitmapSurface   *surface
+)
+{
+    return mock_rgba_surface_create(MOCK_OBJECT_BITMAP_SURFACE,
+                                    format, width, height, surface);
+}
+
+static VdpStatus mock_bitmap_surface_destroy(VdpBitmapSurface surface)
+{
+    return mock_object_destroy(surface, MOCK_OBJECT_BITMAP_SURFACE);
+}
+
+static VdpStatus
+mock_bitmap_surface_put_bits_native(
+    VdpBitmapSurface    surface,
+    const void * const *src,
+    const uint32_t     *src_pitches,
+    const VdpRect      *dst_rect
+)
+{
+    return mock_rgba_surface_put_bits(surface, MOCK_OBJECT_BITMAP_SURFACE,
+                                      src, src_pitches, dst_rect);
+}
+
+// Scales src_rect of src into dst_rect of dst. Pixels are blended with
+// source alpha if a blend state is given, and copied otherwise
+static void
+mock_render_rgba(
+    mock_object_t      *dst,
+    const VdpRect      *dst_rect,
+    mock_object_t      *src,
+    const VdpRect      *src_rect,
+    int                 blend
+)
+{
+    VdpRect d, s;
+    uint32_t x, y, sw, sh, dw, dh;
+
+    mock_get_rect(dst_rect, dst->width, dst->height, &d);
+    if (src)
+        mock_get_rect(src_rect, src->width, src->height, &s);
+    else
+        s = d;
+
+    dw = d.x1 > d.x0 ? d.x1 - d.x0 : 0;
+    dh = d.y1 > d.y0 ? d.y1 - d.y0 : 0;
+    sw = s.x1 > s.x0 ? s.x1 - s.x0 : 0;
+    sh = s.y1 > s.y0 ? s.y1 - s.y0 : 0;
+    if (dw == 0 || dh == 0 || (src && (sw == 0 || sh == 0)))
+        return;
+
+    for (y = 0; y < dh; y++) {
+        uint8_t * const drow = dst->data + ((d.y0 + y) * dst->width + d.x0) * 4;
+        for (x = 0; x < dw; x++) {
+            uint8_t * const dp = drow + 4 * x;
+            const uint8_t *sp;
+            unsigned int a, i;
+
+            if (!src) {
+                /* No source means opaque white */
+                dp[0] = dp[1] = dp[2] = dp[3] = 0xff;
+                continue;
+            }
+            sp = src->data + ((s.y0 + y * sh / dh) * src->width +
+                              (s.x0 + x * sw / dw)) * 4;
+            if (!blend) {
+                memcpy(dp, sp, 4);
+                continue;
+            }
+            a = sp[3];
+            for (i = 0; i < 4; i++)
+                dp[i] = (sp[i] * a + dp[i] * (255 - a) + 127) / 255;
+        }
+    }
+}
+
+static VdpStatus
+mock_output_surface_render_surface(
+    VdpOutputSurface                        dst_surface,
+    const VdpRect                          *dst_rect,
+    uint32_t                                src_surface,
+    mock_object_type_t                      src_type,
+    const VdpRect                          *src_rect,
+    const VdpOutputSurfaceRenderBlendState *blend_state
+)
+{
+    mock_object_t *dst, *src = NULL;
+
+    MOCK_LOOKUP(dst, dst_surface, OUTPUT_SURFACE);
+    if (src_surface != VDP_INVALID_HANDLE) {
+        src = mock_object_lookup(src_surface, src_type);
+        if (!src) {
+            MOCK_UNLOCK();
+            return VDP_STATUS_INVALID_HANDLE;
+        }
+    }
+    mock_render_rgba(dst, dst_rect, src, src_rect, blend_state != NULL);
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_output_surface_render_bitmap_surface(
+    VdpOutputSurface                        dst_surface,
+    const VdpRect                          *dst_rect,
+    VdpBitmapSurface                        src_surface,
+    const VdpRect                          *src_rect,
+    const VdpColor                         *colors,
+    const VdpOutputSurfaceRenderBlendState *blend_state,
+    uint32_t                                flags
+)
+{
+    return mock_output_surface_render_surface(dst_surface, dst_rect,
+                                              src_surface,
+                                              MOCK_OBJECT_BITMAP_SURFACE,
+                                              src_rect, blend_state);
+}
+
+static VdpStatus
+mock_output_surface_render_output_surface(
+    VdpOutputSurface                        dst_surface,
+    const VdpRect                          *dst_rect,
+    VdpOutputSurface                        src_surface,
+    const VdpRect                          *src_rect,
+    const VdpColor                         *colors,
+    const VdpOutputSurfaceRenderBlendState *blend_state,
+    uint32_t                                flags
+)
+{
+    return mock_output_surface_render_surface(dst_surface, dst_rect,
+                                              src_surface,
+                                              MOCK_OBJECT_OUTPUT_SURFACE,
+                                              src_rect, blend_state);
+}
+
+/* ====================================================================== */
+/* === Decoder                                                        === */
+/* ====================================================================== */
+
+static int mock_is_decoder_profile(VdpDecoderProfile profile)
+{
+    switch (profile) {
+    case VDP_DECODER_PROFILE_MPEG1:
+    case VDP_DECODER_PROFILE_MPEG2_SIMPLE:
+    case VDP_DECODER_PROFILE_MPEG2_MAIN:
+    case VDP_DECODER_PROFILE_H264_BASELINE:
+    case VDP_DECODER_PROFILE_H264_MAIN:
+    case VDP_DECODER_PROFILE_H264_HIGH:
+    case VDP_DECODER_PROFILE_VC1_SIMPLE:
+    case VDP_DECODER_PROFILE_VC1_MAIN:
+    case VDP_DECODER_PROFILE_VC1_ADVANCED:
+#if HAVE_VDPAU_MPEG4
+    case VDP_DECODER_PROFILE_MPEG4_PART2_SP:
+    case VDP_DECODER_PROFILE_MPEG4_PART2_ASP:
+#endif
+        return 1;
+    }
+    return 0;
+}
+
+static VdpStatus
+mock_decoder_query_capabilities(
+    VdpDevice           device,
+    VdpDecoderProfile   profile,
+    VdpBool            *is_supported,
+    uint32_t           *max_level,
+    uint32_t           *max_macroblocks,
+    uint32_t           *max_width,
+    uint32_t           *max_height
+)
+{
+    if (!is_supported || !max_level || !max_macroblocks ||
+        !max_width || !max_height)
+        return VDP_STATUS_INVALID_POINTER;
+
+    *is_supported    = mock_is_decoder_profile(profile);
+    *max_level       = 51;
+    *max_macroblocks = (MOCK_MAX_SIZE / 16) * (MOCK_MAX_SIZE / 16);
+    *max_width       = MOCK_MAX_SIZE;
+    *max_height      = MOCK_MAX_SIZE;
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_decoder_create(
+    VdpDevice           device,
+    VdpDecoderProfile   profile,
+    uint32_t            width,
+    uint32_t            height,
+    uint32_t            max_references,
+    VdpDecoder         *decoder
+)
+{
+    VdpStatus vdp_status;
+
+    if (!mock_is_decoder_profile(profile))
+        return VDP_STATUS_INVALID_DECODER_PROFILE;
+    if (width == 0 || height == 0 || width > MOCK_MAX_SIZE || height > MOCK_MAX_SIZE)
+        return VDP_STATUS_INVALID_SIZE;
+
+    vdp_status = mock_object_create(MOCK_OBJECT_DECODER, width, height,
+                                    0, 0, decoder);
+    if (vdp_status == VDP_STATUS_OK) {
+        stats_mutex_lock(&g_mock_lock);
+        mock_object_lookup(*decoder, MOCK_OBJECT_DECODER)->profile = profile;
+        MOCK_UNLOCK();
+    }
+    return vdp_status;
+}
+
+static VdpStatus mock_decoder_destroy(VdpDecoder decoder)
+{
+    return mock_object_destroy(decoder, MOCK_OBJECT_DECODER);
+}
+
+static VdpStatus
+mock_decoder_render(
+    VdpDecoder                decoder,
+    VdpVideoSurface           target,
+    const VdpPictureInfo     *picture_info,
+    uint32_t                  bitstream_buffers_count,
+    const VdpBitstreamBuffer *bitstream_buffers
+)
+{
+    mock_object_t *obj_decoder, *obj_surface;
+    uint32_t checksum = 2166136261U;
+    uint32_t i, j;
+
+    if (!picture_info || (bitstream_buffers_count > 0 && !bitstream_buffers))
+        return VDP_STATUS_INVALID_POINTER;
+
+    /* FNV-1a, computed before taking the lock */
+    for (i = 0; i < bitstream_buffers_count; i++) {
+        const uint8_t * const data = bitstream_buffers[i].bitstream;
+        for (j = 0; j < bitstream_buffers[i].bitstream_bytes; j++) {
+            checksum ^= data[j];
+            checksum *= 16777619U;
+        }
+    }
+
+    MOCK_LOOKUP(obj_decoder, decoder, DECODER);
+    obj_surface = mock_object_lookup(target, MOCK_OBJECT_VIDEO_SURFACE);
+    if (!obj_surface) {
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+    obj_surface->checksum = checksum;
+    for (i = 0; i + 4 <= obj_surface->width; i += 4)
+        memcpy(VIDEO_SURFACE_Y(obj_surface) + i, &checksum, 4);
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+/* ====================================================================== */
+/* === Video mixer                                                    === */
+/* ====================================================================== */
+
+static VdpStatus
+mock_video_mixer_query_feature_support(
+    VdpDevice            device,
+    VdpVideoMixerFeature feature,
+    VdpBool             *is_supported
+)
+{
+    if (!is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+    *is_supported = VDP_FALSE;
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_mixer_query_attribute_support(
+    VdpDevice              device,
+    VdpVideoMixerAttribute attribute,
+    VdpBool               *is_supported
+)
+{
+    if (!is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+    *is_supported = (attribute == VDP_VIDEO_MIXER_ATTRIBUTE_BACKGROUND_COLOR ||
+                     attribute == VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX);
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_mixer_create(
+    VdpDevice                     device,
+    uint32_t                      feature_count,
+    const VdpVideoMixerFeature   *features,
+    uint32_t                      parameter_count,
+    const VdpVideoMixerParameter *parameters,
+    const void * const           *parameter_values,
+    VdpVideoMixer                *mixer
+)
+{
+    return mock_object_create(MOCK_OBJECT_VIDEO_MIXER, 0, 0, 0, 0, mixer);
+}
+
+static VdpStatus mock_video_mixer_destroy(VdpVideoMixer mixer)
+{
+    return mock_object_destroy(mixer, MOCK_OBJECT_VIDEO_MIXER);
+}
+
+static VdpStatus
+mock_video_mixer_get_feature_enables(
+    VdpVideoMixer               mixer,
+    uint32_t                    feature_count,
+    const VdpVideoMixerFeature *features,
+    VdpBool                    *feature_enables
+)
+{
+    uint32_t i;
+
+    if (feature_count > 0 && !feature_enables)
+        return VDP_STATUS_INVALID_POINTER;
+    for (i = 0; i < feature_count; i++)
+        feature_enables[i] = VDP_FALSE;
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_mixer_set_feature_enables(
+    VdpVideoMixer               mixer,
+    uint32_t                    feature_count,
+    const VdpVideoMixerFeature *features,
+    const VdpBool              *feature_enables
+)
+{
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_mixer_get_attribute_values(
+    VdpVideoMixer                 mixer,
+    uint32_t                      attribute_count,
+    const VdpVideoMixerAttribute *attributes,
+    void * const                 *attribute_values
+)
+{
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_mixer_set_attribute_values(
+    VdpVideoMixer                 mixer,
+    uint32_t                      attribute_count,
+    const VdpVideoMixerAttribute *attributes,
+    const void * const           *attribute_values
+)
+{
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_video_mixer_render(
+    VdpVideoMixer                 mixer,
+    VdpOutputSurface              background_surface,
+    const VdpRect                *background_source_rect,
+    VdpVideoMixerPictureStructure current_picture_structure,
+    uint32_t                      video_surface_past_count,
+    const VdpVideoSurface        *video_surface_past,
+    VdpVideoSurface               video_surface_current,
+    uint32_t                      video_surface_future_count,
+    const VdpVideoSurface        *video_surface_future,
+    const VdpRect                *video_source_rect,
+    VdpOutputSurface              destination_surface,
+    const VdpRect                *destination_rect,
+    const VdpRect                *destination_video_rect,
+    uint32_t                      layer_count,
+    const VdpLayer               *layers
+)
+{
+    mock_object_t *obj_mixer, *src, *dst;
+    uint32_t x, y, sw, sh, dw, dh;
+    VdpRect s, d;
+
+    MOCK_LOOKUP(obj_mixer, mixer, VIDEO_MIXER);
+    src = mock_object_lookup(video_surface_current, MOCK_OBJECT_VIDEO_SURFACE);
+    dst = mock_object_lookup(destination_surface, MOCK_OBJECT_OUTPUT_SURFACE);
+    if (!src || !dst) {
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+
+    mock_get_rect(video_source_rect, src->width, src->height, &s);
+    mock_get_rect(destination_video_rect ? destination_video_rect : destination_rect,
+                  dst->width, dst->height, &d);
+    sw = s.x1 > s.x0 ? s.x1 - s.x0 : 0;
+    sh = s.y1 > s.y0 ? s.y1 - s.y0 : 0;
+    dw = d.x1 > d.x0 ? d.x1 - d.x0 : 0;
+    dh = d.y1 > d.y0 ? d.y1 - d.y0 : 0;
+
+    /* Nearest neighbour scaling and BT.601 conversion, fields are
+       rendered as full frames. Layers are not composited */
+    for (y = 0; sw > 0 && sh > 0 && y < dh; y++) {
+        const uint32_t sy = s.y0 + y * sh / dh;
+        uint8_t * const drow = dst->data + ((d.y0 + y) * dst->width + d.x0) * 4;
+        for (x = 0; x < dw; x++) {
+            const uint32_t sx = s.x0 + x * sw / dw;
+            const int Y = VIDEO_SURFACE_Y(src)[sy * src->width + sx] - 16;
+            const int U = VIDEO_SURFACE_U(src)[(sy / 2) * (src->width / 2) + sx / 2] - 128;
+            const int V = VIDEO_SURFACE_V(src)[(sy / 2) * (src->width / 2) + sx / 2] - 128;
+            const uint8_t r = mock_clamp((298 * Y + 409 * V + 128) >> 8);
+            const uint8_t g = mock_clamp((298 * Y - 100 * U - 208 * V + 128) >> 8);
+            const uint8_t b = mock_clamp((298 * Y + 516 * U + 128) >> 8);
+            uint8_t * const dp = drow + 4 * x;
+            if (dst->format == VDP_RGBA_FORMAT_B8G8R8A8) {
+                dp[0] = b; dp[1] = g; dp[2] = r;
+            }
+            else {
+                dp[0] = r; dp[1] = g; dp[2] = b;
+            }
+            dp[3] = 0xff;
+        }
+    }
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+/* ====================================================================== */
+/* === Presentation queues                                            === */
+/* ====================================================================== */
+
+static VdpStatus
+mock_presentation_queue_target_create_x11(
+    VdpDevice                   device,
+    Drawable                    drawable,
+    VdpPresentationQueueTarget *target
+)
+{
+    return mock_object_create(MOCK_OBJECT_PRESENTATION_QUEUE_TARGET,
+                              0, 0, 0, 0, target);
+}
+
+static VdpStatus
+mock_presentation_queue_target_destroy(VdpPresentationQueueTarget target)
+{
+    return mock_object_destroy(target, MOCK_OBJECT_PRESENTATION_QUEUE_TARGET);
+}
+
+static VdpStatus
+mock_presentation_queue_create(
+    VdpDevice                   device,
+    VdpPresentationQueueTarget  target,
+    VdpPresentationQueue       *queue
+)
+{
+    mock_object_t *obj;
+
+    MOCK_LOOKUP(obj, target, PRESENTATION_QUEUE_TARGET);
+    MOCK_UNLOCK();
+    return mock_object_create(MOCK_OBJECT_PRESENTATION_QUEUE,
+                              0, 0, 0, 0, queue);
+}
+
+static VdpStatus mock_presentation_queue_destroy(VdpPresentationQueue queue)
+{
+    return mock_object_destroy(queue, MOCK_OBJECT_PRESENTATION_QUEUE);
+}
+
+static VdpStatus
+mock_presentation_queue_set_background_color(
+    VdpPresentationQueue        queue,
+    VdpColor * const            background_color
+)
+{
+    mock_object_t *obj;
+
+    if (!background_color)
+        return VDP_STATUS_INVALID_POINTER;
+    MOCK_LOOKUP(obj, queue, PRESENTATION_QUEUE);
+    obj->background = *background_color;
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_presentation_queue_get_background_color(
+    VdpPresentationQueue        queue,
+    VdpColor                   *background_color
+)
+{
+    mock_object_t *obj;
+
+    if (!background_color)
+        return VDP_STATUS_INVALID_POINTER;
+    MOCK_LOOKUP(obj, queue, PRESENTATION_QUEUE);
+    *background_color = obj->background;
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_presentation_queue_display(
+    VdpPresentationQueue        queue,
+    VdpOutputSurface            surface,
+    uint32_t                    clip_width,
+    uint32_t                    clip_height,
+    VdpTime                     earliest_presentation_time
+)
+{
+    const VdpTime period = mock_refresh_period();
+    mock_object_t *obj_queue, *obj_surface, *obj_last;
+    VdpTime present_time;
+
+    MOCK_LOOKUP(obj_queue, queue, PRESENTATION_QUEUE);
+    obj_surface = mock_object_lookup(surface, MOCK_OBJECT_OUTPUT_SURFACE);
+    if (!obj_surface) {
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+
+    /* Flip on the next refresh, at most once per refresh */
+    present_time = MAX(get_ticks_nsec(), earliest_presentation_time);
+    present_time = (present_time / period + 1) * period;
+    if (obj_queue->last_surface && present_time <= obj_queue->last_time)
+        present_time = obj_queue->last_time + period;
+
+    obj_last = mock_object_lookup(obj_queue->last_surface,
+                                  MOCK_OBJECT_OUTPUT_SURFACE);
+    if (obj_last && obj_last->present_queue == queue)
+        obj_last->idle_time = present_time;
+
+    obj_surface->present_queue = queue;
+    obj_surface->present_time  = present_time;
+    obj_surface->idle_time     = 0;
+    obj_queue->last_surface    = surface;
+    obj_queue->last_time       = present_time;
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+// Computes the status of the surface at time now, the mock lock must be held
+static VdpPresentationQueueStatus
+mock_get_surface_status(mock_object_t *obj_surface, uint32_t queue, VdpTime now)
+{
+    if (obj_surface->present_queue != queue || obj_surface->present_time == 0)
+        return VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+    if (now < obj_surface->present_time)
+        return VDP_PRESENTATION_QUEUE_STATUS_QUEUED;
+    if (obj_surface->idle_time && now >= obj_surface->idle_time)
+        return VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+    return VDP_PRESENTATION_QUEUE_STATUS_VISIBLE;
+}
+
+static VdpStatus
+mock_presentation_queue_query_surface_status(
+    VdpPresentationQueue        queue,
+    VdpOutputSurface            surface,
+    VdpPresentationQueueStatus *status,
+    VdpTime                    *first_presentation_time
+)
+{
+    mock_object_t *obj_queue, *obj_surface;
+
+    if (!status || !first_presentation_time)
+        return VDP_STATUS_INVALID_POINTER;
+
+    MOCK_LOOKUP(obj_queue, queue, PRESENTATION_QUEUE);
+    obj_surface = mock_object_lookup(surface, MOCK_OBJECT_OUTPUT_SURFACE);
+    if (!obj_surface) {
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+    *status = mock_get_surface_status(obj_surface, queue, get_ticks_nsec());
+    *first_presentation_time =
+        *status == VDP_PRESENTATION_QUEUE_STATUS_QUEUED ? 0 : obj_surface->present_time;
+    MOCK_UNLOCK();
+    return VDP_STATUS_OK;
+}
+
+static VdpStatus
+mock_presentation_queue_block_until_surface_idle(
+    VdpPresentationQueue        queue,
+    VdpOutputSurface            surface,
+    VdpTime                    *first_presentation_time
+)
+{
+    mock_object_t *obj_queue, *obj_surface;
+    VdpTime idle_time, now;
+
+    if (!first_presentation_time)
+        return VDP_STATUS_INVALID_POINTER;
+
+    MOCK_LOOKUP(obj_queue, queue, PRESENTATION_QUEUE);
+    obj_surface = mock_object_lookup(surface, MOCK_OBJECT_OUTPUT_SURFACE);
+    if (!obj_surface) {
+        MOCK_UNLOCK();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+    /* A surface that nothing replaces would block forever, return
+       immediately instead */
+    idle_time = obj_surface->present_queue == queue ? obj_surface->idle_time : 0;
+    *first_presentation_time = obj_surface->present_time;
+    MOCK_UNLOCK();
+
+    now = get_ticks_nsec();
+    if (idle_time > now)
+        delay_usec((idle_time - now + 999) / 1000);
+    return VDP_STATUS_OK;
+}
+
+/* ====================================================================== */
+/* === Device creation                                                === */
+/* ====================================================================== */
+
+typedef struct {
+    VdpFuncId           func_id;
+    void               *func;
+} mock_proc_t;
+
+static const mock_proc_t mock_procs[] = {
+#define _(FUNC_ID, func) { VDP_FUNC_ID_##FUNC_ID, (void *)mock_##func }
+    _(GET_ERROR_STRING,                         get_error_string),
+    _(GET_API_VERSION,                          get_api_version),
+    _(GET_INFORMATION_STRING,                   get_information_string),
+    _(DEVICE_DESTROY,                           device_destroy),
+    _(GENERATE_CSC_MATRIX,                      generate_csc_matrix),
+    _(VIDEO_SURFACE_QUERY_GET_PUT_BITS_Y_CB_CR_CAPABILITIES,
+                                                video_surface_query_ycbcr_caps),
+    _(VIDEO_SURFACE_CREATE,                     video_surface_create),
+    _(VIDEO_SURFACE_DESTROY,                    video_surface_destroy),
+    _(VIDEO_SURFACE_GET_BITS_Y_CB_CR,           video_surface_get_bits_ycbcr),
+    _(VIDEO_SURFACE_PUT_BITS_Y_CB_CR,           video_surface_put_bits_ycbcr),
+    _(OUTPUT_SURFACE_QUERY_GET_PUT_BITS_NATIVE_CAPABILITIES,
+                                                output_surface_query_rgba_caps),
+    _(OUTPUT_SURFACE_QUERY_PUT_BITS_INDEXED_CAPABILITIES,
+                                                output_surface_query_put_bits_indexed_capabilities),
+    _(OUTPUT_SURFACE_CREATE,                    output_surface_create),
+    _(OUTPUT_SURFACE_DESTROY,                   output_surface_destroy),
+    _(OUTPUT_SURFACE_GET_BITS_NATIVE,           output_surface_get_bits_native),
+    _(OUTPUT_SURFACE_PUT_BITS_NATIVE,           output_surface_put_bits_native),
+    _(OUTPUT_SURFACE_PUT_BITS_INDEXED,          output_surface_put_bits_indexed),
+    _(OUTPUT_SURFACE_RENDER_OUTPUT_SURFACE,     output_surface_render_output_surface),
+    _(OUTPUT_SURFACE_RENDER_BITMAP_SURFACE,     output_surface_render_bitmap_surface),
+    _(BITMAP_SURFACE_QUERY_CAPABILITIES,        bitmap_surface_query_capabilities),
+    _(BITMAP_SURFACE_CREATE,                    bitmap_surface_create),
+    _(BITMAP_SURFACE_DESTROY,                   bitmap_surface_destroy),
+    _(BITMAP_SURFACE_PUT_BITS_NATIVE,           bitmap_surface_put_bits_native),
+    _(DECODER_QUERY_CAPABILITIES,               decoder_query_capabilities),
+    _(DECODER_CREATE,                           decoder_create),
+    _(DECODER_DESTROY,                          decoder_destroy),
+    _(DECODER_RENDER,                           decoder_render),
+    _(VIDEO_MIXER_QUERY_FEATURE_SUPPORT,        video_mixer_query_feature_support),
+    _(VIDEO_MIXER_QUERY_ATTRIBUTE_SUPPORT,      video_mixer_query_attribute_support),
+    _(VIDEO_MIXER_CREATE,                       video_mixer_create),
+    _(VIDEO_MIXER_DESTROY,                      video_mixer_destroy),
+    _(VIDEO_MIXER_GET_FEATURE_ENABLES,          video_mixer_get_feature_enables),
+    _(VIDEO_MIXER_SET_FEATURE_ENABLES,          video_mixer_set_feature_enables),
+    _(VIDEO_MIXER_GET_ATTRIBUTE_VALUES,         video_mixer_get_attribute_values),
+    _(VIDEO_MIXER_SET_ATTRIBUTE_VALUES,         video_mixer_set_attribute_values),
+    _(VIDEO_MIXER_RENDER,                       video_mixer_render),
+    _(PRESENTATION_QUEUE_TARGET_CREATE_X11,     presentation_queue_target_create_x11),
+    _(PRESENTATION_QUEUE_TARGET_DESTROY,        presentation_queue_target_destroy),
+    _(PRESENTATION_QUEUE_CREATE,                presentation_queue_create),
+    _(PRESENTATION_QUEUE_DESTROY,               presentation_queue_destroy),
+    _(PRESENTATION_QUEUE_SET_BACKGROUND_COLOR,  presentation_queue_set_background_color),
+    _(PRESENTATION_QUEUE_GET_BACKGROUND_COLOR,  presentation_queue_get_background_color),
+    _(PRESENTATION_QUEUE_DISPLAY,               presentation_queue_display),
+    _(PRESENTATION_QUEUE_BLOCK_UNTIL_SURFACE_IDLE,
+                                                presentation_queue_block_until_surface_idle),
+    _(PRESENTATION_QUEUE_QUERY_SURFACE_STATUS,  presentation_queue_query_surface_status),
+#undef _
+};
+
+static VdpStatus
+mock_get_proc_address(VdpDevice device, VdpFuncId func_id, void **func)
+{
+    mock_object_t *obj;
+    unsigned int i;
+
+    if (!func)
+        return VDP_STATUS_INVALID_POINTER;
+    *func = NULL;
+
+    MOCK_LOOKUP(obj, device, DEVICE);
+    MOCK_UNLOCK();
+
+    for (i = 0; i < ARRAY_ELEMS(mock_procs); i++) {
+        if (mock_procs[i].func_id == func_id) {
+            *func = mock_procs[i].func;
+            return VDP_STATUS_OK;
+        }
+    }
+    return VDP_STATUS_INVALID_FUNC_ID;
+}
+
+// Creates the software VDPAU device
+VdpStatus
+vdpau_mock_device_create(
+    VdpDevice          *device,
+    VdpGetProcAddress **get_proc_address
+)
+{
+    VdpStatus vdp_status;
+
+    if (!device || !get_proc_address)
+        return VDP_STATUS_INVALID_POINTER;
+
+    vdp_status = mock_object_create(MOCK_OBJECT_DEVICE, 0, 0, 0, 0, device);
+    if (vdp_status != VDP_STATUS_OK)
+        return vdp_status;
+
+    *get_proc_address = mock_get_proc_address;
+    vdpau_information_message("using the software VDPAU device\n");
+    return VDP_STATUS_OK;
+}
@@ -0,0 +1,37 @@
+/*
+ *  vdpau_mock.h - Software VDPAU device for running without a GPU
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef VDPAU_MOCK_H
+#define VDPAU_MOCK_H
+
+#include "vdpau_gate.h"
+
+// Checks whether the software VDPAU device is used instead of the GPU
+int vdpau_mock_enabled(void)
+    attribute_hidden;
+
+// Creates the software VDPAU device, a stand-in for vdp_device_create_x11()
+VdpStatus
+vdpau_mock_device_create(
+    VdpDevice          *device,
+    VdpGetProcAddress **get_proc_address
+) attribute_hidden;
+
+#endif /* VDPAU_MOCK_H */
@@ -0,0 +1,621 @@
+/*
+ *  vdpau_replay.c - Replay decode captures against the software device
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "sysdeps.h"
+#include "vdpau_driver.h"
+#include "vdpau_buffer.h"
+#include "vdpau_capture.h"
+#include "vdpau_decode.h"
+#include "vdpau_video.h"
+#include "utils.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define DEBUG 1
+#include "debug.h"
+
+/*
+ * Replays the VA buffers recorded in decode captures (see
+ * VDPAU_VIDEO_CAPTURE) through vdpau_BeginPicture(), vdpau_RenderPicture()
+ * and vdpau_EndPicture() on the software device, and reports the cost of
+ * the driver per picture:
+ *
+ *   vdpau_replay [-n loops] capture...
+ *
+ * Captures are loaded and contexts created before the timed loop, which
+ * only creates the VA buffers and runs the decode entry points. Surfaces
+ * referenced by picture parameters are remapped to the replay surfaces.
+ * DECODE records are not replayed, the driver issues its own.
+ */
+
+#if !VA_CHECK_VERSION(0,32,0)
+#error "vdpau_replay needs VA-API >= 0.32"
+#endif
+
+#define REPLAY_NUM_SURFACES             16
+#define REPLAY_MAX_CONTEXTS             16
+#define REPLAY_MAX_CAPTURE_SURFACES     64
+#define REPLAY_MAX_PICTURE_BUFFERS      1024
+
+/* Entry point of the driver, normally called by libva */
+VAStatus VA_DRIVER_INIT_FUNC(void *ctx);
+
+typedef struct replay_buffer replay_buffer_t;
+struct replay_buffer {
+    VABufferType        type;
+    unsigned int        size;           /* size of an element */
+    unsigned int        num_elements;
+    void               *data;
+    unsigned int        is_copy;        /* data is a patched copy */
+};
+
+typedef struct replay_picture replay_picture_t;
+struct replay_picture {
+    unsigned int        context;        /* index into replay->contexts */
+    VASurfaceID         render_target;
+    unsigned int        first_buffer;
+    unsigned int        num_buffers;
+};
+
+typedef struct replay_context replay_context_t;
+struct replay_context {
+    uint32_t            capture_context;
+    VAProfile           va_profile;
+    unsigned int        width;
+    unsigned int        height;
+    VAConfigID          config;
+    VAContextID         context;
+    VASurfaceID         surfaces[REPLAY_NUM_SURFACES];
+    unsigned int        num_pictures;
+    VASurfaceID         capture_surfaces[REPLAY_MAX_CAPTURE_SURFACES];
+    unsigned int        num_capture_surfaces;
+};
+
+typedef struct replay_file replay_file_t;
+struct replay_file {
+    uint8_t            *map;
+    size_t              map_size;
+};
+
+typedef struct replay replay_t;
+struct replay {
+    struct VADriverContext driver_context;
+    struct VADriverVTable vtable;
+    unsigned int        is_initialized;
+    replay_context_t    contexts[REPLAY_MAX_CONTEXTS];
+    unsigned int        num_contexts;
+    replay_file_t      *files;
+    unsigned int        num_files;
+    unsigned int        num_files_max;
+    replay_picture_t   *pictures;
+    unsigned int        num_pictures;
+    unsigned int        num_pictures_max;
+    replay_buffer_t    *buffers;
+    unsigned int        num_buffers;
+    unsigned int        num_buffers_max;
+};
+
+typedef struct replay_stats replay_stats_t;
+struct replay_stats {
+    uint64_t            pictures;
+    uint64_t            buffers;
+    uint64_t            total_ns;
+    uint64_t            buffer_ns;      /* vaCreateBuffer() and vaRenderPicture() */
+    uint64_t            allocations;
+    uint64_t            locks;
+};
+
+// Loads the driver on the software device
+static int replay_init(replay_t *replay)
+{
+    VAStatus va_status;
+
+    /* Statistics must be enabled before the driver first checks them */
+    setenv("VDPAU_VIDEO_MOCK", "yes", 1);
+    setenv("VDPAU_VIDEO_STATS", "yes", 1);
+    unsetenv("VDPAU_VIDEO_CAPTURE");
+
+    replay->driver_context.vtable = &replay->vtable;
+    va_status = VA_DRIVER_INIT_FUNC(&replay->driver_context);
+    if (va_status != VA_STATUS_SUCCESS) {
+        vdpau_error_message("failed to initialize the driver (%d)\n",
+                            va_status);
+        return -1;
+    }
+    replay->is_initialized = 1;
+    return 0;
+}
+
+// Destroys the contexts, unloads the driver and unmaps the captures
+static void replay_exit(replay_t *replay)
+{
+    VADriverContextP const ctx = &replay->driver_context;
+    unsigned int i;
+
+    if (replay->is_initialized) {
+        for (i = 0; i < replay->num_contexts; i++) {
+            replay_context_t * const rctx = &replay->contexts[i];
+            vdpau_DestroyContext(ctx, rctx->context);
+            vdpau_DestroySurfaces(ctx, rctx->surfaces, REPLAY_NUM_SURFACES);
+            vdpau_DestroyConfig(ctx, rctx->config);
+        }
+        replay->vtable.vaTerminate(ctx);
+        replay->is_initialized = 0;
+    }
+    replay->num_contexts = 0;
+
+    for (i = 0; i < replay->num_buffers; i++) {
+        if (replay->buffers[i].is_copy)
+            free(replay->buffers[i].data);
+    }
+    free(replay->buffers);
+    replay->buffers = NULL;
+    replay->num_buffers = 0;
+
+    free(replay->pictures);
+    replay->pictures = NULL;
+    replay->num_pictures = 0;
+
+    for (i = 0; i < replay->num_files; i++)
+        munmap(replay->files[i].map, replay->files[i].map_size);
+    free(replay->files);
+    replay->files = NULL;
+    replay->num_files = 0;
+}
+
+// Returns the replay context for the captured one, creating it if needed
+static replay_context_t *
+get_context(replay_t *replay, const vdpau_capture_begin_picture_t *args)
+{
+    VADriverContextP const ctx = &replay->driver_context;
+    replay_context_t *rctx;
+    VAStatus va_status;
+    unsigned int i;
+
+    for (i = 0; i < replay->num_contexts; i++) {
+        rctx = &replay->contexts[i];
+        if (rctx->capture_context == args->context &&
+            rctx->va_profile      == (VAProfile)args->va_profile &&
+            rctx->width           == args->width &&
+            rctx->height          == args->height)
+            return rctx;
+    }
+
+    if (replay->num_contexts >= REPLAY_MAX_CONTEXTS) {
+        vdpau_error_message("too many contexts in the captures\n");
+        return NULL;
+    }
+    rctx = &replay->contexts[replay->num_contexts];
+    memset(rctx, 0, sizeof(*rctx));
+    rctx->capture_context = args->context;
+    rctx->va_profile      = args->va_profile;
+    rctx->width           = args->width;
+    rctx->height          = args->height;
+
+    va_status = vdpau_CreateConfig(ctx, rctx->va_profile, VAEntrypointVLD,
+                                   NULL, 0, &rctx->config);
+    if (va_status != VA_STATUS_SUCCESS) {
+        vdpau_error_message("unsupported profile %d (%d)\n",
+                            rctx->va_profile, va_status);
+        return NULL;
+    }
+    va_status = vdpau_CreateSurfaces(ctx, rctx->width, rctx->height,
+                                     VA_RT_FORMAT_YUV420, REPLAY_NUM_SURFACES,
+                                     rctx->surfaces);
+    if (va_status != VA_STATUS_SUCCESS) {
+        vdpau_error_message("failed to create %ux%u surfaces (%d)\n",
+                            rctx->width, rctx->height, va_status);
+        vdpau_DestroyConfig(ctx, rctx->config);
+        return NULL;
+    }
+    va_status = vdpau_CreateContext(ctx, rctx->config,
+                                    rctx->width, rctx->height, VA_PROGRESSIVE,
+                                    rctx->surfaces, REPLAY_NUM_SURFACES,
+                                    &rctx->context);
+    if (va_status != VA_STATUS_SUCCESS) {
+        vdpau_error_message("failed to create a %ux%u context (%d)\n",
+                            rctx->width, rctx->height, va_status);
+        vdpau_DestroySurfaces(ctx, rctx->surfaces, REPLAY_NUM_SURFACES);
+        vdpau_DestroyConfig(ctx, rctx->config);
+        return NULL;
+    }
+    replay->num_contexts++;
+    return rctx;
+}
+
+// Maps a surface of the captured application to a replay surface
+static VASurfaceID
+map_surface(replay_context_t *rctx, VASurfaceID capture_surface)
+{
+    unsigned int i;
+
+    if (capture_surface == VA_INVALID_SURFACE)
+        return VA_INVALID_SURFACE;
+
+    for (i = 0; i < rctx->num_capture_surfaces; i++) {
+        if (rctx->capture_surfaces[i] == capture_surface)
+            return rctx->surfaces[i % REPLAY_NUM_SURFACES];
+    }
+    if (i < REPLAY_MAX_CAPTURE_SURFACES) {
+        rctx->capture_surfaces[rctx->num_capture_surfaces++] = capture_surface;
+        return rctx->surfaces[i % REPLAY_NUM_SURFACES];
+    }
+    return rctx->surfaces[capture_surface % REPLAY_NUM_SURFACES];
+}
+
+// Remaps the surfaces referenced by a picture parameter buffer, in place
+// The render target is updated if the buffer names it (H.264)
+static int
+patch_picture_parameters(
+    replay_context_t   *rctx,
+    replay_buffer_t    *buffer,
+    VASurfaceID        *render_target
+)
+{
+    const unsigned int size = buffer->size * buffer->num_elements;
+    unsigned int i;
+
+    switch (rctx->va_profile) {
+    case VAProfileMPEG2Simple:
+    case VAProfileMPEG2Main: {
+        VAPictureParameterBufferMPEG2 * const pic_param = buffer->data;
+        if (size < sizeof(*pic_param))
+            return 0;
+        pic_param->forward_reference_picture =
+            map_surface(rctx, pic_param->forward_reference_picture);
+        pic_param->backward_reference_picture =
+            map_surface(rctx, pic_param->backward_reference_picture);
+        break;
+    }
+    case VAProfileMPEG4Simple:
+    case VAProfileMPEG4AdvancedSimple:
+    case VAProfileMPEG4Main: {
+        VAPictureParameterBufferMPEG4 * const pic_param = buffer->data;
+        if (size < sizeof(*pic_param))
+            return 0;
+        pic_param->forward_reference_picture =
+            map_surface(rctx, pic_param->forward_reference_picture);
+        pic_param->backward_reference_picture =
+            map_surface(rctx, pic_param->backward_reference_picture);
+        break;
+    }
+    case VAProfileH264Baseline:
+    case VAProfileH264Main:
+    case VAProfileH264High: {
+        VAPictureParameterBufferH264 * const pic_param = buffer->data;
+        if (size < sizeof(*pic_param))
+            return 0;
+        pic_param->CurrPic.picture_id =
+            map_surface(rctx, pic_param->CurrPic.picture_id);
+        if (pic_param->CurrPic.picture_id != VA_INVALID_SURFACE)
+            *render_target = pic_param->CurrPic.picture_id;
+        for (i = 0; i < ARRAY_ELEMS(pic_param->ReferenceFrames); i++)
+            pic_param->ReferenceFrames[i].picture_id =
+                map_surface(rctx, pic_param->ReferenceFrames[i].picture_id);
+        break;
+    }
+    case VAProfileVC1Simple:
+    case VAProfileVC1Main:
+    case VAProfileVC1Advanced: {
+        VAPictureParameterBufferVC1 * const pic_param = buffer->data;
+        if (size < sizeof(*pic_param))
+            return 0;
+        pic_param->forward_reference_picture =
+            map_surface(rctx, pic_param->forward_reference_picture);
+        pic_param->backward_reference_picture =
+            map_surface(rctx, pic_param->backward_reference_picture);
+        pic_param->inloop_decoded_picture =
+            map_surface(rctx, pic_param->inloop_decoded_picture);
+        break;
+    }
+    default:
+        break;
+    }
+    return 1;
+}
+
+// Appends a captured VA buffer to the current picture
+static int
+add_buffer(
+    replay_t                        *replay,
+    replay_context_t                *rctx,
+    replay_picture_t                *picture,
+    const vdpau_capture_va_buffer_t *args,
+    const uint8_t                   *data
+)
+{
+    replay_buffer_t *buffer;
+
+    if (args->num_elements == 0 || args->buffer_size % args->num_elements) {
+        vdpau_error_message("invalid VA buffer of %u bytes in %u elements\n",
+                            args->buffer_size, args->num_elements);
+        return -1;
+    }
+    if (picture->num_buffers >= REPLAY_MAX_PICTURE_BUFFERS) {
+        vdpau_error_message("too many VA buffers in a picture\n");
+        return -1;
+    }
+
+    if (!realloc_buffer((void **)&replay->buffers, &replay->num_buffers_max,
+                        replay->num_buffers + 1, sizeof(*replay->buffers)))
+        return -1;
+    buffer = &replay->buffers[replay->num_buffers];
+    buffer->type         = args->type;
+    buffer->size         = args->buffer_size / args->num_elements;
+    buffer->num_elements = args->num_elements;
+    buffer->data         = (void *)data;
+    buffer->is_copy      = 0;
+
+    if (buffer->type == VAPictureParameterBufferType) {
+        buffer->data = malloc(args->buffer_size);
+        if (!buffer->data)
+            return -1;
+        memcpy(buffer->data, data, args->buffer_size);
+        buffer->is_copy = 1;
+        if (!patch_picture_parameters(rctx, buffer, &picture->render_target)) {
+            free(buffer->data);
+            vdpau_error_message("truncated picture parameters\n");
+            return -1;
+        }
+    }
+    replay->num_buffers++;
+    picture->num_buffers++;
+    return 0;
+}
+
+// Loads the pictures of a capture file
+static int load_capture(replay_t *replay, const char *filename)
+{
+    const vdpau_capture_header_t *header;
+    const vdpau_capture_record_t *record;
+    replay_context_t *rctx = NULL;
+    replay_picture_t *picture = NULL;
+    replay_file_t *file;
+    struct stat st;
+    uint64_t offset;
+    void *map;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*header)) {
+        vdpau_error_message("failed to open capture %s\n", filename);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        vdpau_error_message("failed to map capture %s\n", filename);
+        return -1;
+    }
+    if (!realloc_buffer((void **)&replay->files, &replay->num_files_max,
+                        replay->num_files + 1, sizeof(*replay->files))) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    file = &replay->files[replay->num_files++];
+    file->map      = map;
+    file->map_size = st.st_size;
+
+    header = map;
+    if (memcmp(header->magic, VDPAU_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VDPAU_CAPTURE_VERSION ||
+        header->header_size < sizeof(*header) ||
+        header->header_size > file->map_size) {
+        vdpau_error_message("%s is not a version %d decode capture\n",
+                            filename, VDPAU_CAPTURE_VERSION);
+        return -1;
+    }
+
+    for (offset = header->header_size;
+         offset + sizeof(*record) <= file->map_size;
+         offset += record->record_size) {
+        const uint8_t *args;
+        record = (const vdpau_capture_record_t *)(file->map + offset);
+        if (record->record_size < sizeof(*record) ||
+            record->record_size > file->map_size - offset)
+            break;
+        args = (const uint8_t *)(record + 1);
+
+        switch (record->type) {
+        case VDPAU_CAPTURE_BEGIN_PICTURE: {
+            const vdpau_capture_begin_picture_t * const begin = (const void *)args;
+            if (record->record_size < sizeof(*record) + sizeof(*begin))
+                goto error_truncated;
+            if (picture) {
+                vdpau_error_message("%s: interleaved pictures are not "
+                                    "supported\n", filename);
+                return -1;
+            }
+            rctx = get_context(replay, begin);
+            if (!rctx)
+                return -1;
+            if (!realloc_buffer((void **)&replay->pictures,
+                                &replay->num_pictures_max,
+                                replay->num_pictures + 1,
+                                sizeof(*replay->pictures)))
+                return -1;
+            picture = &replay->pictures[replay->num_pictures];
+            picture->context       = rctx - replay->contexts;
+            picture->render_target =
+                rctx->surfaces[rctx->num_pictures++ % REPLAY_NUM_SURFACES];
+            picture->first_buffer  = replay->num_buffers;
+            picture->num_buffers   = 0;
+            break;
+        }
+        case VDPAU_CAPTURE_VA_BUFFER: {
+            const vdpau_capture_va_buffer_t * const va_buffer = (const void *)args;
+            if (record->record_size < sizeof(*record) + sizeof(*va_buffer) ||
+                va_buffer->buffer_size > record->record_size - sizeof(*record) - sizeof(*va_buffer))
+                goto error_truncated;
+            if (!picture || va_buffer->context != rctx->capture_context)
+                break;
+            if (add_buffer(replay, rctx, picture, va_buffer,
+                           args + sizeof(*va_buffer)) < 0)
+                return -1;
+            break;
+        }
+        case VDPAU_CAPTURE_END_PICTURE:
+            if (picture && picture->num_buffers > 0)
+                replay->num_pictures++;
+            picture = NULL;
+            break;
+        default:
+            break;
+        }
+    }
+    if (offset != file->map_size)
+        goto error_truncated;
+    return 0;
+
+error_truncated:
+    vdpau_error_message("%s: truncated record at offset %llu\n",
+                        filename, (unsigned long long)offset);
+    return -1;
+}
+
+// Decodes all loaded pictures once, accumulating into stats
+static int replay_pictures(replay_t *replay, replay_stats_t *stats)
+{
+    VADriverContextP const ctx = &replay->driver_context;
+    VABufferID buffer_ids[REPLAY_MAX_PICTURE_BUFFERS];
+    uint64_t start_ticks, buffer_ticks;
+    VAStatus va_status;
+    unsigned int i, j;
+
+    start_ticks = get_ticks_nsec();
+    for (i = 0; i < replay->num_pictures; i++) {
+        const replay_picture_t * const picture = &replay->pictures[i];
+        const replay_context_t * const rctx = &replay->contexts[picture->context];
+
+        va_status = vdpau_BeginPicture(ctx, rctx->context, picture->render_target);
+        if (va_status != VA_STATUS_SUCCESS)
+            goto error;
+
+        buffer_ticks = get_ticks_nsec();
+        for (j = 0; j < picture->num_buffers; j++) {
+            const replay_buffer_t * const buffer =
+                &replay->buffers[picture->first_buffer + j];
+            va_status = vdpau_CreateBuffer(ctx, rctx->context, buffer->type,
+                                           buffer->size, buffer->num_elements,
+                                           buffer->data, &buffer_ids[j]);
+            if (va_status != VA_STATUS_SUCCESS)
+                goto error;
+        }
+        va_status = vdpau_RenderPicture(ctx, rctx->context,
+                                        buffer_ids, picture->num_buffers);
+        if (va_status != VA_STATUS_SUCCESS)
+            goto error;
+        stats->buffer_ns += get_ticks_nsec() - buffer_ticks;
+
+        va_status = vdpau_EndPicture(ctx, rctx->context);
+        if (va_status != VA_STATUS_SUCCESS)
+            goto error;
+        stats->buffers += picture->num_buffers;
+    }
+
+    /* Pictures may still be queued to the decode thread */
+    for (i = 0; i < replay->num_contexts; i++) {
+        for (j = 0; j < REPLAY_NUM_SURFACES; j++) {
+            va_status = vdpau_SyncSurface2(ctx, replay->contexts[i].surfaces[j]);
+            if (va_status != VA_STATUS_SUCCESS)
+                goto error;
+        }
+    }
+    stats->total_ns += get_ticks_nsec() - start_ticks;
+    stats->pictures += replay->num_pictures;
+    return 0;
+
+error:
+    vdpau_error_message("picture %u failed to decode (%d)\n", i, va_status);
+    return -1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n loops] capture...\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    replay_t replay;
+    replay_stats_t stats;
+    unsigned int n, loops = 1;
+    int i, c, ret = 1;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+        case 'n':
+            loops = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || loops == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&replay, 0, sizeof(replay));
+    memset(&stats, 0, sizeof(stats));
+    if (replay_init(&replay) < 0)
+        goto end;
+    for (i = optind; i < argc; i++) {
+        if (load_capture(&replay, argv[i]) < 0)
+            goto end;
+    }
+    if (replay.num_pictures == 0) {
+        vdpau_error_message("no pictures to replay\n");
+        goto end;
+    }
+
+    stats.allocations = g_stats_counters.allocations;
+    stats.locks       = g_stats_counters.locks;
+    for (n = 0; n < loops; n++) {
+        if (replay_pictures(&replay, &stats) < 0)
+            goto end;
+    }
+    stats.allocations = g_stats_counters.allocations - stats.allocations;
+    stats.locks       = g_stats_counters.locks - stats.locks;
+
+    printf("%llu pictures, %llu buffers, %u contexts\n",
+           (unsigned long long)stats.pictures,
+           (unsigned long long)stats.buffers,
+           replay.num_contexts);
+    printf("%.1f fps, %llu ns per picture\n",
+           stats.total_ns ? 1e9 * stats.pictures / stats.total_ns : 0.0,
+           (unsigned long long)(stats.total_ns / stats.pictures));
+    printf("%llu ns per buffer\n",
+           (unsigned long long)(stats.buffers ? stats.buffer_ns / stats.buffers : 0));
+    printf("%.2f allocations per picture\n",
+           (double)stats.allocations / stats.pictures);
+    printf("%.2f lock acquisitions per picture\n",
+           (double)stats.locks / stats.pictures);
+    ret = 0;
+
+end:
+    replay_exit(&replay);
+    return ret;
+}
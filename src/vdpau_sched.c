@@ -0,0 +1,332 @@
+/*
+ *  vdpau_sched.c - Decoder admission control
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "sysdeps.h"
+#include "vdpau_sched.h"
+#include "vaapi_compat.h"
+#include "utils.h"
+#include <sys/time.h>
+#include <errno.h>
+
+#define DEBUG 1
+#include "debug.h"
+
+/* Learned rates are updated once per window */
+#define VDPAU_SCHED_WINDOW_NS           1000000000ULL
+#define VDPAU_SCHED_DEFAULT_FPS         30
+
+static unsigned int get_sched_env(const char *env, int default_value)
+{
+    int value;
+    if (getenv_int(env, &value) < 0 || value < 0)
+        value = default_value;
+    return value;
+}
+
+// Accumulates the utilization since the last update, the lock must be held
+static void sched_update(vdpau_sched_t *sched)
+{
+    const uint64_t now = get_ticks_nsec();
+    const uint64_t usecs = (now - sched->update_ticks) / 1000;
+
+    sched->mb_rate_usecs  += sched->mb_rate  * usecs;
+    sched->sessions_usecs += sched->sessions * usecs;
+    sched->update_ticks    = now;
+}
+
+// Checks whether a session at that rate fits, the lock must be held
+static int sched_fits(vdpau_sched_t *sched, uint64_t mb_rate)
+{
+    if (sched->max_sessions &&
+        sched->sessions + sched->pooled >= sched->max_sessions)
+        return 0;
+
+    /* A session larger than the whole budget runs alone */
+    if (sched->max_mb_rate && sched->sessions > 0 &&
+        sched->mb_rate + mb_rate > sched->max_mb_rate)
+        return 0;
+    return 1;
+}
+
+// Destroys the idle decoders if they are what keeps a session from
+// fitting, the lock must be held and is dropped meanwhile
+// Returns 1 if decoders were reclaimed, 0 otherwise
+static int sched_reclaim(vdpau_sched_t *sched)
+{
+    unsigned int pooled = sched->pooled;
+
+    if (!sched->reclaim || pooled == 0 || !sched->max_sessions ||
+        sched->sessions >= sched->max_sessions ||
+        sched->sessions + pooled < sched->max_sessions)
+        return 0;
+
+    /* The pool accounts the destroyed decoders through vdpau_sched_pooled() */
+    pthread_mutex_unlock(&sched->lock);
+    sched->reclaim(sched->reclaim_data);
+    stats_mutex_lock(&sched->lock);
+    return sched->pooled < pooled;
+}
+
+// Computes the absolute time timeout_ms milliseconds from now
+static void get_deadline(struct timespec *deadline, unsigned int timeout_ms)
+{
+    struct timeval now;
+    uint64_t nsec;
+
+    gettimeofday(&now, NULL);
+    nsec = (uint64_t)now.tv_usec * 1000 + (uint64_t)timeout_ms * 1000000;
+    deadline->tv_sec  = now.tv_sec + nsec / 1000000000;
+    deadline->tv_nsec = nsec % 1000000000;
+}
+
+// Reads the scheduling budget from the environment
+void
+vdpau_sched_init(
+    vdpau_sched_t           *sched,
+    vdpau_sched_reclaim_func reclaim,
+    void                    *reclaim_data
+)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->reclaim       = reclaim;
+    sched->reclaim_data  = reclaim_data;
+    sched->max_sessions  = get_sched_env("VDPAU_VIDEO_MAX_DECODERS", 0);
+    sched->max_mb_rate   = get_sched_env("VDPAU_VIDEO_MAX_MB_RATE", 0);
+    sched->admit_timeout = get_sched_env("VDPAU_VIDEO_ADMIT_TIMEOUT", 0);
+    sched->expected_fps  = get_sched_env("VDPAU_VIDEO_EXPECTED_FPS",
+                                         VDPAU_SCHED_DEFAULT_FPS);
+    sched->start_ticks   = get_ticks_nsec();
+    sched->update_ticks  = sched->start_ticks;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->cond, NULL);
+    sched->is_initialized = 1;
+}
+
+// Releases the scheduler, all sessions must have been released
+void
+vdpau_sched_exit(vdpau_sched_t *sched)
+{
+    if (!sched->is_initialized)
+        return;
+
+    ASSERT(sched->sessions == 0 && !sched->waiters);
+    pthread_cond_destroy(&sched->cond);
+    pthread_mutex_destroy(&sched->lock);
+    sched->is_initialized = 0;
+}
+
+// Admits a session decoding pictures of the specified size
+VAStatus
+vdpau_sched_admit(
+    vdpau_sched_t         *sched,
+    vdpau_sched_session_t *session,
+    unsigned int           width,
+    unsigned int           height
+)
+{
+    vdpau_sched_waiter_t waiter, **pwaiter;
+    struct timespec deadline;
+    uint64_t start_ticks = 0;
+    uint64_t mb_rate;
+    int can_admit = 1;
+
+    memset(session, 0, sizeof(*session));
+    session->mbs = ((width + 15) / 16) * ((height + 15) / 16);
+    mb_rate = (uint64_t)session->mbs * sched->expected_fps;
+
+    stats_mutex_lock(&sched->lock);
+
+    if (!sched->waiters && !sched_fits(sched, mb_rate))
+        sched_reclaim(sched);
+
+    /* Sessions are admitted in arrival order: a new session queues
+       behind earlier ones even if it would fit */
+    if (sched->waiters || !sched_fits(sched, mb_rate)) {
+        if (sched->admit_timeout == 0) {
+            sched->rejected++;
+            pthread_mutex_unlock(&sched->lock);
+            return VA_STATUS_ERROR_HW_BUSY;
+        }
+
+        sched->queued++;
+        start_ticks = get_ticks_nsec();
+        get_deadline(&deadline, sched->admit_timeout);
+        waiter.next = NULL;
+        for (pwaiter = &sched->waiters; *pwaiter; pwaiter = &(*pwaiter)->next)
+            ;
+        *pwaiter = &waiter;
+
+        while (sched->waiters != &waiter || !sched_fits(sched, mb_rate)) {
+            /* A released session may have left its decoder in the pool */
+            if (sched->waiters == &waiter && sched_reclaim(sched))
+                continue;
+            if (pthread_cond_timedwait(&sched->cond, &sched->lock,
+                                       &deadline) == ETIMEDOUT) {
+                /* Capacity may have been returned right at the deadline */
+                can_admit = (sched->waiters == &waiter &&
+                             sched_fits(sched, mb_rate));
+                break;
+            }
+        }
+
+        for (pwaiter = &sched->waiters; *pwaiter != &waiter; pwaiter = &(*pwaiter)->next)
+            ;
+        *pwaiter = waiter.next;
+        sched->queued_ns += get_ticks_nsec() - start_ticks;
+
+        /* Let the next session in line check for capacity */
+        pthread_cond_broadcast(&sched->cond);
+
+        if (!can_admit) {
+            sched->rejected++;
+            pthread_mutex_unlock(&sched->lock);
+            return VA_STATUS_ERROR_HW_BUSY;
+        }
+    }
+
+    sched_update(sched);
+    sched->sessions++;
+    sched->mb_rate += mb_rate;
+    sched->admitted++;
+    if (sched->peak_sessions < sched->sessions)
+        sched->peak_sessions = sched->sessions;
+    if (sched->peak_mb_rate < sched->mb_rate)
+        sched->peak_mb_rate = sched->mb_rate;
+    pthread_mutex_unlock(&sched->lock);
+
+    session->is_admitted  = 1;
+    session->mb_rate      = mb_rate;
+    session->window_start = get_ticks_nsec();
+    return VA_STATUS_SUCCESS;
+}
+
+// Returns the capacity of an admitted session to the scheduler
+void
+vdpau_sched_release(
+    vdpau_sched_t         *sched,
+    vdpau_sched_session_t *session
+)
+{
+    if (!session->is_admitted)
+        return;
+
+    stats_mutex_lock(&sched->lock);
+    sched_update(sched);
+    sched->sessions--;
+    sched->mb_rate -= session->mb_rate;
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+
+    session->is_admitted = 0;
+    session->mb_rate     = 0;
+}
+
+// Accounts idle decoders added to (delta > 0) or removed from the pool
+void
+vdpau_sched_pooled(vdpau_sched_t *sched, int delta)
+{
+    if (!sched->is_initialized || delta == 0)
+        return;
+
+    stats_mutex_lock(&sched->lock);
+    ASSERT(delta > 0 || sched->pooled >= (unsigned int)-delta);
+    sched->pooled += delta;
+    if (delta < 0)
+        pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+}
+
+// Accounts a picture submitted by the session
+void
+vdpau_sched_picture(
+    vdpau_sched_t         *sched,
+    vdpau_sched_session_t *session
+)
+{
+    uint64_t now, elapsed, mb_rate;
+
+    if (!session->is_admitted)
+        return;
+
+    session->window_pictures++;
+    now = get_ticks_nsec();
+    elapsed = now - session->window_start;
+    if (elapsed < VDPAU_SCHED_WINDOW_NS)
+        return;
+
+    /* Replace the accounted rate with the one observed over the window */
+    mb_rate = (uint64_t)session->mbs * session->window_pictures *
+        VDPAU_SCHED_WINDOW_NS / elapsed;
+    session->window_start    = now;
+    session->window_pictures = 0;
+
+    stats_mutex_lock(&sched->lock);
+    sched_update(sched);
+    sched->mb_rate += mb_rate - session->mb_rate;
+    if (sched->peak_mb_rate < sched->mb_rate)
+        sched->peak_mb_rate = sched->mb_rate;
+    if (mb_rate < session->mb_rate)
+        pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+    session->mb_rate = mb_rate;
+}
+
+// Dumps sessions and utilization
+void
+vdpau_sched_dump_statistics(vdpau_sched_t *sched)
+{
+    uint64_t usecs;
+
+    if (!sched->is_initialized || sched->admitted + sched->rejected == 0)
+        return;
+
+    stats_mutex_lock(&sched->lock);
+    sched_update(sched);
+    usecs = (sched->update_ticks - sched->start_ticks) / 1000;
+    if (usecs == 0)
+        usecs = 1;
+
+    vdpau_information_message("scheduler: %llu sessions admitted, %llu queued "
+                              "for %llu ms in total, %llu rejected\n",
+                              (unsigned long long)sched->admitted,
+                              (unsigned long long)sched->queued,
+                              (unsigned long long)(sched->queued_ns / 1000000),
+                              (unsigned long long)sched->rejected);
+    vdpau_information_message("scheduler: %.2f sessions on average, %u at peak, "
+                              "budget %u\n",
+                              (double)sched->sessions_usecs / usecs,
+                              sched->peak_sessions,
+                              sched->max_sessions);
+    if (sched->max_mb_rate)
+        vdpau_information_message("scheduler: %llu macroblocks/s on average, "
+                                  "%llu at peak, budget %llu (%.1f%% "
+                                  "utilization)\n",
+                                  (unsigned long long)(sched->mb_rate_usecs / usecs),
+                                  (unsigned long long)sched->peak_mb_rate,
+                                  (unsigned long long)sched->max_mb_rate,
+                                  100.0 * sched->mb_rate_usecs / usecs /
+                                  sched->max_mb_rate);
+    else
+        vdpau_information_message("scheduler: %llu macroblocks/s on average, "
+                                  "%llu at peak, no budget\n",
+                                  (unsigned long long)(sched->mb_rate_usecs / usecs),
+                                  (unsigned long long)sched->peak_mb_rate);
+    pthread_mutex_unlock(&sched->lock);
+}
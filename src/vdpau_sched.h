@@ -0,0 +1,130 @@
+/*
+ *  vdpau_sched.h - Decoder admission control
+ *
+ *  libva-vdpau-driver (C) 2009-2011 Splitted-Desktop Systems
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef VDPAU_SCHED_H
+#define VDPAU_SCHED_H
+
+#include <va/va.h>
+#include <pthread.h>
+
+/*
+ * Decoding sessions are admitted at vaCreateContext() against a budget
+ * of concurrent sessions and of macroblocks per second. A session is
+ * first accounted at the rate of its picture size times the expected
+ * frame rate, and then at the rate learned from its submissions.
+ *
+ * Idle decoders kept for reuse still hold hardware sessions, so they
+ * count against the session budget. They are reclaimed before a new
+ * session is queued or rejected for lack of sessions.
+ */
+
+// Destroys the idle decoders, returns how many were destroyed
+typedef unsigned int (*vdpau_sched_reclaim_func)(void *data);
+
+typedef struct vdpau_sched_waiter vdpau_sched_waiter_t;
+struct vdpau_sched_waiter {
+    vdpau_sched_waiter_t *next;
+};
+
+typedef struct vdpau_sched vdpau_sched_t;
+struct vdpau_sched {
+    unsigned int          is_initialized;
+    pthread_mutex_t       lock;
+    pthread_cond_t        cond;
+    vdpau_sched_waiter_t *waiters;          /* sessions queued for admission, oldest first */
+    unsigned int          max_sessions;     /* 0 means unlimited */
+    uint64_t              max_mb_rate;      /* macroblocks per second, 0 means unlimited */
+    unsigned int          admit_timeout;    /* milliseconds to wait for capacity */
+    unsigned int          expected_fps;
+    unsigned int          sessions;
+    unsigned int          pooled;           /* idle decoders holding sessions */
+    vdpau_sched_reclaim_func reclaim;
+    void                 *reclaim_data;
+    uint64_t              mb_rate;
+    unsigned int          peak_sessions;
+    uint64_t              peak_mb_rate;
+    uint64_t              admitted;
+    uint64_t              queued;
+    uint64_t              rejected;
+    uint64_t              queued_ns;
+    uint64_t              start_ticks;
+    uint64_t              update_ticks;
+    uint64_t              mb_rate_usecs;    /* mb_rate integrated over time */
+    uint64_t              sessions_usecs;   /* sessions integrated over time */
+};
+
+typedef struct vdpau_sched_session vdpau_sched_session_t;
+struct vdpau_sched_session {
+    unsigned int          is_admitted;
+    uint32_t              mbs;              /* macroblocks per picture */
+    uint64_t              mb_rate;          /* rate accounted for the session */
+    uint64_t              window_start;
+    unsigned int          window_pictures;
+};
+
+// Reads the scheduling budget from the environment. reclaim is called
+// to give up idle decoders when they block a session
+void
+vdpau_sched_init(
+    vdpau_sched_t           *sched,
+    vdpau_sched_reclaim_func reclaim,
+    void                    *reclaim_data
+) attribute_hidden;
+
+// Releases the scheduler, all sessions must have been released
+void
+vdpau_sched_exit(vdpau_sched_t *sched)
+    attribute_hidden;
+
+// Admits a session decoding pictures of the specified size, waiting
+// for capacity up to the admission timeout
+VAStatus
+vdpau_sched_admit(
+    vdpau_sched_t         *sched,
+    vdpau_sched_session_t *session,
+    unsigned int           width,
+    unsigned int           height
+) attribute_hidden;
+
+// Returns the capacity of an admitted session to the scheduler
+void
+vdpau_sched_release(
+    vdpau_sched_t         *sched,
+    vdpau_sched_session_t *session
+) attribute_hidden;
+
+// Accounts idle decoders added to (delta > 0) or removed from the pool
+void
+vdpau_sched_pooled(vdpau_sched_t *sched, int delta)
+    attribute_hidden;
+
+// Accounts a picture submitted by the session
+void
+vdpau_sched_picture(
+    vdpau_sched_t         *sched,
+    vdpau_sched_session_t *session
+) attribute_hidden;
+
+// Dumps sessions and utilization
+void
+vdpau_sched_dump_statistics(vdpau_sched_t *sched)
+    attribute_hidden;
+
+#endif /* VDPAU_SCHED_H */
@@ -31,10 +31,22 @@
 #include "debug.h"
 
 
-/* Define wait delay (in microseconds) for vaSyncSurface() implementation
-   with polling. */
+/* Define maximum wait delay (in microseconds) for vaSyncSurface()
+   implementation with polling. The first polls use a shorter delay,
+   see get_sync_delay() */
 #define VDPAU_SYNC_DELAY 5000
 
+/* Define default initial wait delay (in microseconds) and the number of
+   polls performed with it before backing off to VDPAU_SYNC_DELAY */
+#define VDPAU_SYNC_DELAY_MIN    100
+#define VDPAU_SYNC_SPIN_COUNT   4
+
+/* Lower bound of the first vaSyncSurface() latency histogram bucket */
+#define VDPAU_SYNC_LATENCY_MIN_SHIFT 6
+
+// Number of VA buffers typically submitted per picture
+#define VDPAU_BUFFERS_PER_PICTURE 4
+
 // Translates VA-API chroma format to VdpChromaType
 static VdpChromaType get_VdpChromaType(int format)
 {
@@ -51,48 +63,6 @@ static VdpChromaType get_VdpChromaType(int format)
 /* === VA-API Implementation with VDPAU                               === */
 /* ====================================================================== */
 
-// Returns the maximum dimensions supported by the VDPAU implementation for that profile
-static inline VdpBool
-get_max_surface_size(
-    vdpau_driver_data_t *driver_data,
-    VdpDecoderProfile    profile,
-    uint32_t            *pmax_width,
-    uint32_t            *pmax_height
-)
-{
-    VdpBool is_supported = VDP_FALSE;
-    VdpStatus vdp_status;
-    uint32_t max_level, max_references, max_width, max_height;
-
-    if (pmax_width)
-        *pmax_width = 0;
-    if (pmax_height)
-        *pmax_height = 0;
-
-    vdp_status = vdpau_decoder_query_capabilities(
-        driver_data,
-        driver_data->vdp_device,
-        profile,
-        &is_supported,
-        &max_level,
-        &max_references,
-        &max_width,
-        &max_height
-    );
-    if (!VDPAU_CHECK_STATUS(vdp_status, "VdpDecoderQueryCapabilities()"))
-        return VDP_FALSE;
-
-    if (!is_supported)
-        return VDP_FALSE;
-
-    if (pmax_width)
-        *pmax_width = max_width;
-    if (max_height)
-        *pmax_height = max_height;
-
-    return VDP_TRUE;
-}
-
 // vaGetConfigAttributes
 VAStatus
 vdpau_GetConfigAttributes(
@@ -193,7 +163,12 @@ vdpau_CreateConfig(
     obj_config->attrib_count = 1;
 
     for(i = 0; i < num_attribs; i++) {
-        va_status = vdpau_update_attribute(obj_config, &attrib_list[i]);
+        if (attrib_list[i].type == VDPAU_CONFIG_ATTRIB_DECODE_POLICY)
+            va_status = check_decode_policy(attrib_list[i].value);
+        else
+            va_status = VA_STATUS_SUCCESS;
+        if (va_status == VA_STATUS_SUCCESS)
+            va_status = vdpau_update_attribute(obj_config, &attrib_list[i]);
         if (va_status != VA_STATUS_SUCCESS) {
             vdpau_DestroyConfig(ctx, configID);
             return va_status;
@@ -326,6 +301,8 @@ vdpau_DestroySurfaces(
         if (!obj_surface)
             continue;
 
+        async_decode_sync(driver_data, obj_surface);
+        surface_map_remove(driver_data, obj_surface);
         if (obj_surface->vdp_surface != VDP_INVALID_HANDLE) {
             vdpau_video_surface_destroy(driver_data, obj_surface->vdp_surface);
             obj_surface->vdp_surface = VDP_INVALID_HANDLE;
@@ -400,6 +377,9 @@ vdpau_CreateSurfaces(
     if (format != VA_RT_FORMAT_YUV420)
         return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
 
+    if (object_heap_reserve(&driver_data->surface_heap, num_surfaces) < 0)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
     for (i = 0; i < num_surfaces; i++) {
         vdp_status = vdpau_video_surface_create(
             driver_data,
@@ -421,6 +401,7 @@ vdpau_CreateSurfaces(
         }
         obj_surface->va_context                 = VA_INVALID_ID;
         obj_surface->va_surface_status          = VASurfaceReady;
+        obj_surface->is_skipped                 = 0;
         obj_surface->vdp_surface                = vdp_surface;
         obj_surface->width                      = width;
         obj_surface->height                     = height;
@@ -432,6 +413,13 @@ vdpau_CreateSurfaces(
         obj_surface->output_surfaces_count      = 0;
         obj_surface->output_surfaces_count_max  = 0;
         obj_surface->video_mixer                = NULL;
+        obj_surface->pending                    = 0;
+        obj_surface->decode_seq                 = 0;
+        obj_surface->decode_status              = VDP_STATUS_OK;
+        obj_surface->mix_output                 = VA_INVALID_ID;
+        obj_surface->mix_seq                    = 0;
+        obj_surface->present_output             = VA_INVALID_ID;
+        obj_surface->present_seq                = 0;
         surfaces[i]                             = va_surface;
         vdp_surface                             = VDP_INVALID_HANDLE;
 
@@ -453,15 +441,16 @@ vdpau_CreateSurfaces(
     return va_status;
 }
 
-// vaDestroyContext
-VAStatus vdpau_DestroyContext(VADriverContextP ctx, VAContextID context)
+// Destroys the context, including any decode still queued for it
+void
+destroy_context(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+)
 {
-    VDPAU_DRIVER_DATA_INIT;
     int i;
 
-    object_context_p obj_context = VDPAU_CONTEXT(context);
-    if (!obj_context)
-        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    async_decode_exit(driver_data, obj_context);
 
     if (obj_context->gen_slice_data) {
         free(obj_context->gen_slice_data);
@@ -477,17 +466,35 @@ VAStatus vdpau_DestroyContext(VADriverContextP ctx, VAContextID context)
         obj_context->vdp_bitstream_buffers_count_max = 0;
     }
 
-    if (obj_context->vdp_decoder != VDP_INVALID_HANDLE) {
-        vdpau_decoder_destroy(driver_data, obj_context->vdp_decoder);
-        obj_context->vdp_decoder = VDP_INVALID_HANDLE;
+    if (obj_context->bitstream_arena) {
+        free(obj_context->bitstream_arena);
+        obj_context->bitstream_arena = NULL;
+        obj_context->bitstream_arena_size = 0;
+        obj_context->bitstream_arena_size_max = 0;
     }
 
+    decoder_pool_release(driver_data, obj_context);
+    vdpau_sched_release(&driver_data->sched, &obj_context->sched_session);
+
     destroy_dead_va_buffers(driver_data, obj_context);
     if (obj_context->dead_buffers) {
         free(obj_context->dead_buffers);
         obj_context->dead_buffers = NULL;
     }
 
+    destroy_recycled_va_buffers(driver_data, obj_context);
+    if (obj_context->recycled_buffers) {
+        free(obj_context->recycled_buffers);
+        obj_context->recycled_buffers = NULL;
+        obj_context->recycled_buffers_count_max = 0;
+    }
+
+    if (obj_context->render_buffers) {
+        free(obj_context->render_buffers);
+        obj_context->render_buffers = NULL;
+        obj_context->render_buffers_count_max = 0;
+    }
+
     if (obj_context->render_targets) {
         for (i = 0; i < obj_context->num_render_targets; i++) {
             object_surface_p obj_surface;
@@ -498,6 +505,7 @@ VAStatus vdpau_DestroyContext(VADriverContextP ctx, VAContextID context)
         free(obj_context->render_targets);
         obj_context->render_targets = NULL;
     }
+    surface_map_exit(obj_context);
 
     obj_context->context_id             = VA_INVALID_ID;
     obj_context->config_id              = VA_INVALID_ID;
@@ -510,6 +518,18 @@ VAStatus vdpau_DestroyContext(VADriverContextP ctx, VAContextID context)
     obj_context->dead_buffers_count_max = 0;
 
     object_heap_free(&driver_data->context_heap, (object_base_p)obj_context);
+}
+
+// vaDestroyContext
+VAStatus vdpau_DestroyContext(VADriverContextP ctx, VAContextID context)
+{
+    VDPAU_DRIVER_DATA_INIT;
+
+    object_context_p obj_context = VDPAU_CONTEXT(context);
+    if (!obj_context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+
+    destroy_context(driver_data, obj_context);
     return VA_STATUS_SUCCESS;
 }
 
@@ -537,14 +557,30 @@ vdpau_CreateContext(
 
     /* XXX: validate flag */
 
+    /* With VDPAU_VIDEO_PROFILE_FALLBACK=yes, streams the hardware rejects
+       for their profile may still be decoded with a decoder of a superset
+       profile. Pictures larger than the hardware limits are rejected */
     VdpDecoderProfile vdp_profile;
-    uint32_t max_width, max_height;
     int i;
-    vdp_profile = get_VdpDecoderProfile(obj_config->profile);
-    if (!get_max_surface_size(driver_data, vdp_profile, &max_width, &max_height))
-        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
-    if (picture_width > max_width || picture_height > max_height)
+    if (picture_width < 0 || picture_height < 0)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+    vdp_profile = get_decoder_profile(driver_data,
+                                      get_VdpDecoderProfile(obj_config->profile),
+                                      picture_width, picture_height);
+    if (vdp_profile == (VdpDecoderProfile)-1) {
+        if (check_decoder(driver_data, obj_config->profile,
+                          obj_config->entrypoint) != VA_STATUS_SUCCESS)
+            return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
         return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+    }
+    if (vdp_profile != get_VdpDecoderProfile(obj_config->profile))
+        D(bug("using VDPAU profile %d for VA profile %d\n",
+              vdp_profile, obj_config->profile));
+
+    /* Make room for the buffers of all in-flight pictures up-front */
+    if (object_heap_reserve(&driver_data->buffer_heap,
+                            num_render_targets * VDPAU_BUFFERS_PER_PICTURE) < 0)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
 
     VAContextID context_id = object_heap_allocate(&driver_data->context_heap);
     if (context_id == VA_INVALID_ID)
@@ -564,20 +600,60 @@ vdpau_CreateContext(
     obj_context->num_render_targets     = num_render_targets;
     obj_context->flags                  = flag;
     obj_context->max_ref_frames         = -1;
+    obj_context->dpb_max_ref_frames     = -1;
     obj_context->render_targets         = (VASurfaceID *)
         calloc(num_render_targets, sizeof(VASurfaceID));
+    obj_context->surface_map            = NULL;
+    obj_context->last_iq_matrix_size    = 0;
+    obj_context->last_seq_fields_valid  = 0;
+    obj_context->surface_map_mask       = 0;
     obj_context->dead_buffers           = NULL;
     obj_context->dead_buffers_count     = 0;
     obj_context->dead_buffers_count_max = 0;
+    obj_context->recycled_buffers       = NULL;
+    obj_context->recycled_buffers_count = 0;
+    obj_context->recycled_buffers_count_max = 0;
+    obj_context->render_buffers         = NULL;
+    obj_context->render_buffers_count_max = 0;
     obj_context->vdp_codec              = get_VdpCodec(vdp_profile);
+    obj_context->codec_ops              = get_codec_ops(obj_context->vdp_codec);
     obj_context->vdp_profile            = vdp_profile;
     obj_context->vdp_decoder            = VDP_INVALID_HANDLE;
+    obj_context->async_queue            = NULL;
     obj_context->gen_slice_data = NULL;
     obj_context->gen_slice_data_size = 0;
     obj_context->gen_slice_data_size_max = 0;
     obj_context->vdp_bitstream_buffers = NULL;
     obj_context->vdp_bitstream_buffers_count = 0;
     obj_context->vdp_bitstream_buffers_count_max = 0;
+    obj_context->bitstream_arena = NULL;
+    obj_context->bitstream_arena_size = 0;
+    obj_context->bitstream_arena_size_max = 0;
+    obj_context->bitstream_arena_frame = 0;
+    memset(obj_context->bitstream_arena_peaks, 0,
+           sizeof(obj_context->bitstream_arena_peaks));
+    memset(&obj_context->sched_session, 0,
+           sizeof(obj_context->sched_session));
+    decode_policy_init(driver_data, obj_context);
+
+    /* Queue or reject the context if the decoder is over budget */
+    VAStatus va_status;
+    va_status = vdpau_sched_admit(&driver_data->sched,
+                                  &obj_context->sched_session,
+                                  picture_width, picture_height);
+    if (va_status != VA_STATUS_SUCCESS) {
+        vdpau_DestroyContext(ctx, context_id);
+        return va_status;
+    }
+
+    if (async_decode_init(driver_data, obj_context) < 0) {
+        vdpau_DestroyContext(ctx, context_id);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    /* Pick up a decoder left over by a previous context, if any.
+       Otherwise, it is created on first vaEndPicture() */
+    decoder_pool_acquire(driver_data, obj_context, -1);
 
     if (!obj_context->render_targets) {
         vdpau_DestroyContext(ctx, context_id);
@@ -595,9 +671,66 @@ vdpau_CreateContext(
         ASSERT(obj_surface->va_context == VA_INVALID_ID);
         obj_surface->va_context = context_id;
     }
+
+    if (surface_map_init(driver_data, obj_context) < 0) {
+        vdpau_DestroyContext(ctx, context_id);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
     return VA_STATUS_SUCCESS;
 }
 
+// Check whether the decode of the surface is still in progress
+static int
+surface_decode_is_pending(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    object_context_p obj_context = VDPAU_CONTEXT(obj_surface->va_context);
+
+    if (obj_context && obj_context->current_render_target == obj_surface->base.id)
+        return 1;
+    return async_decode_is_pending(driver_data, obj_surface);
+}
+
+// Check whether the output surface the surface was mixed into is still
+// queued for display. Its flip number is obj_surface->present_seq
+static int
+surface_present_is_pending(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface,
+    VAStatus            *va_status
+)
+{
+    object_output_p obj_output = VDPAU_OUTPUT(obj_surface->present_output);
+    if (!obj_output)
+        return 0;
+
+    /* The output surface was reused, so the previous contents got idle */
+    if (obj_output->queued_surfaces - obj_surface->present_seq >= VDPAU_MAX_OUTPUT_SURFACES)
+        return 0;
+
+    VdpOutputSurface vdp_output_surface;
+    vdp_output_surface = obj_output->vdp_output_surfaces[obj_surface->present_seq % VDPAU_MAX_OUTPUT_SURFACES];
+    if (vdp_output_surface == VDP_INVALID_HANDLE)
+        return 0;
+
+    VdpPresentationQueueStatus vdp_queue_status;
+    VdpTime vdp_dummy_time;
+    VdpStatus vdp_status;
+    vdp_status = vdpau_presentation_queue_query_surface_status(
+        driver_data,
+        obj_output->vdp_flip_queue,
+        vdp_output_surface,
+        &vdp_queue_status,
+        &vdp_dummy_time
+    );
+    *va_status = vdpau_get_VAStatus(vdp_status);
+    if (vdp_status != VDP_STATUS_OK)
+        return 0;
+    return vdp_queue_status == VDP_PRESENTATION_QUEUE_STATUS_QUEUED;
+}
+
 // Query surface status
 VAStatus
 query_surface_status(
@@ -608,38 +741,40 @@ query_surface_status(
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
 
-    if (obj_surface->va_surface_status == VASurfaceDisplaying) {
-        unsigned int i, num_output_surfaces_displaying = 0;
-        for (i = 0; i < obj_surface->output_surfaces_count; i++) {
-            object_output_p obj_output = obj_surface->output_surfaces[i];
-            if (!obj_output)
-                return VA_STATUS_ERROR_INVALID_SURFACE;
-
-            VdpOutputSurface vdp_output_surface;
-            vdp_output_surface = obj_output->vdp_output_surfaces[obj_output->displayed_output_surface];
-            if (vdp_output_surface == VDP_INVALID_HANDLE)
-                continue;
-
-            VdpPresentationQueueStatus vdp_queue_status;
-            VdpTime vdp_dummy_time;
-            VdpStatus vdp_status;
-            vdp_status = vdpau_presentation_queue_query_surface_status(
-                driver_data,
-                obj_output->vdp_flip_queue,
-                vdp_output_surface,
-                &vdp_queue_status,
-                &vdp_dummy_time
-            );
-            va_status = vdpau_get_VAStatus(vdp_status);
-
-            if (vdp_queue_status != VDP_PRESENTATION_QUEUE_STATUS_VISIBLE)
-                ++num_output_surfaces_displaying;
+    if (obj_surface->pending & SURFACE_PENDING_DECODE) {
+        if (!surface_decode_is_pending(driver_data, obj_surface))
+            obj_surface->pending &= ~SURFACE_PENDING_DECODE;
+    }
+    if (!(obj_surface->pending & SURFACE_PENDING_DECODE))
+        va_status = async_decode_get_status(driver_data, obj_surface);
+
+    if (obj_surface->pending & SURFACE_PENDING_MIX) {
+        /* The output surface was flipped since the surface was mixed into it */
+        object_output_p obj_output = VDPAU_OUTPUT(obj_surface->mix_output);
+        if (!obj_output)
+            obj_surface->pending &= ~SURFACE_PENDING_MIX;
+        else if (obj_output->queued_surfaces != obj_surface->mix_seq) {
+            obj_surface->pending    &= ~SURFACE_PENDING_MIX;
+            obj_surface->pending       |= SURFACE_PENDING_PRESENT;
+            obj_surface->present_output = obj_surface->mix_output;
+            obj_surface->present_seq    = obj_surface->mix_seq;
         }
+    }
 
-        if (num_output_surfaces_displaying == 0)
-            obj_surface->va_surface_status = VASurfaceReady;
+    if (obj_surface->pending & SURFACE_PENDING_PRESENT) {
+        if (!surface_present_is_pending(driver_data, obj_surface, &va_status))
+            obj_surface->pending &= ~SURFACE_PENDING_PRESENT;
     }
 
+    if (obj_surface->pending & SURFACE_PENDING_DECODE)
+        obj_surface->va_surface_status = VASurfaceRendering;
+    else if (obj_surface->pending & (SURFACE_PENDING_MIX|SURFACE_PENDING_PRESENT))
+        obj_surface->va_surface_status = VASurfaceDisplaying;
+    else if (obj_surface->is_skipped)
+        obj_surface->va_surface_status = VASurfaceSkipped;
+    else
+        obj_surface->va_surface_status = VASurfaceReady;
+
     if (status)
         *status = obj_surface->va_surface_status;
 
@@ -663,34 +798,170 @@ vdpau_QuerySurfaceStatus(
     return query_surface_status(driver_data, obj_surface, status);
 }
 
-// Wait for the surface to complete pending operations
-VAStatus
-sync_surface(
+// Get initial wait delay of polling vaSyncSurface() implementation
+static unsigned int get_sync_delay_env(void)
+{
+    int sync_delay;
+    if (getenv_int("VDPAU_VIDEO_SYNC_DELAY", &sync_delay) < 0)
+        sync_delay = VDPAU_SYNC_DELAY_MIN;
+    if (sync_delay < 1)
+        sync_delay = 1;
+    else if (sync_delay > VDPAU_SYNC_DELAY)
+        sync_delay = VDPAU_SYNC_DELAY;
+    return sync_delay;
+}
+
+static inline unsigned int get_sync_delay(void)
+{
+    static int g_sync_delay = -1;
+    if (g_sync_delay < 0)
+        g_sync_delay = get_sync_delay_env();
+    return g_sync_delay;
+}
+
+// Record vaSyncSurface() latency into a log2 histogram
+static void
+sync_surface_record_latency(vdpau_driver_data_t *driver_data, uint64_t latency)
+{
+    unsigned int i;
+
+    latency >>= VDPAU_SYNC_LATENCY_MIN_SHIFT;
+    for (i = 0; latency > 0 && i < VDPAU_SYNC_LATENCY_BUCKETS - 1; i++)
+        latency >>= 1;
+    ATOMIC_ADD(&driver_data->sync_latency[i], 1);
+}
+
+// Dump vaSyncSurface() latency histogram
+void
+sync_surface_dump_statistics(vdpau_driver_data_t *driver_data)
+{
+    unsigned int i;
+
+    for (i = 0; i < VDPAU_SYNC_LATENCY_BUCKETS; i++) {
+        if (driver_data->sync_latency[i] == 0)
+            continue;
+        if (i < VDPAU_SYNC_LATENCY_BUCKETS - 1)
+            vdpau_information_message("vaSyncSurface: < %7u us: %llu\n",
+                                      1U << (i + VDPAU_SYNC_LATENCY_MIN_SHIFT),
+                                      (unsigned long long)driver_data->sync_latency[i]);
+        else
+            vdpau_information_message("vaSyncSurface: >= %6u us: %llu\n",
+                                      1U << (i - 1 + VDPAU_SYNC_LATENCY_MIN_SHIFT),
+                                      (unsigned long long)driver_data->sync_latency[i]);
+    }
+    if (driver_data->sync_blocked > 0 || driver_data->sync_polled > 0)
+        vdpau_information_message("vaSyncSurface: %llu blocked, %llu polled\n",
+                                  (unsigned long long)driver_data->sync_blocked,
+                                  (unsigned long long)driver_data->sync_polled);
+}
+
+// Block until the presented frame of the surface is visible, i.e. until
+// the previous output surface in the flip ring went idle
+// Returns 0 on success, -1 if presentation status has to be polled
+static int
+sync_surface_present_blocking(
     vdpau_driver_data_t *driver_data,
     object_surface_p     obj_surface
 )
 {
-    /* VDPAU only supports status interface for in-progress display */
-    /* XXX: polling is bad but there currently is no alternative */
-    for (;;) {
-        VASurfaceStatus va_surface_status;
-        VAStatus va_status;
+    object_output_p obj_output = VDPAU_OUTPUT(obj_surface->present_output);
+    if (!obj_output)
+        return -1;
 
-        va_status = query_surface_status(
-            driver_data,
-            obj_surface,
-            &va_surface_status
-        );
+    /* The previous output surface is only known to hold the previous
+       frame while the surface is the last one queued for display */
+    if (obj_surface->present_seq == 0 ||
+        obj_output->queued_surfaces != obj_surface->present_seq + 1)
+        return -1;
+
+    VdpOutputSurface vdp_output_surface;
+    vdp_output_surface = obj_output->vdp_output_surfaces[(obj_surface->present_seq - 1) % VDPAU_MAX_OUTPUT_SURFACES];
+    if (vdp_output_surface == VDP_INVALID_HANDLE)
+        return -1;
+
+    VdpTime dummy_time;
+    VdpStatus vdp_status;
+    vdp_status = vdpau_presentation_queue_block_until_surface_idle(
+        driver_data,
+        obj_output->vdp_flip_queue,
+        vdp_output_surface,
+        &dummy_time
+    );
+    if (!VDPAU_CHECK_STATUS(vdp_status, "VdpPresentationQueueBlockUntilSurfaceIdle()"))
+        return -1;
+    return 0;
+}
+
+// Wait for the presented frame of the surface to leave the queue
+static VAStatus
+sync_surface_present(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    unsigned int delay = get_sync_delay();
+    unsigned int n;
+    VAStatus va_status;
+
+    /* Only wait for the outstanding work of this very surface. A
+       pending mix needs no wait: VDPAU orders any later use of the
+       video surface after the mixer operation */
+    va_status = query_surface_status(driver_data, obj_surface, NULL);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+    if (!(obj_surface->pending & SURFACE_PENDING_PRESENT))
+        return VA_STATUS_SUCCESS;
+
+    if (sync_surface_present_blocking(driver_data, obj_surface) == 0) {
+        if (stats_enabled())
+            ATOMIC_ADD(&driver_data->sync_blocked, 1);
+        va_status = query_surface_status(driver_data, obj_surface, NULL);
         if (va_status != VA_STATUS_SUCCESS)
             return va_status;
+        if (!(obj_surface->pending & SURFACE_PENDING_PRESENT))
+            return VA_STATUS_SUCCESS;
+    }
+
+    /* Otherwise, poll the presentation queue status, with a short delay
+       first and then backing off exponentially to VDPAU_SYNC_DELAY */
+    if (stats_enabled())
+        ATOMIC_ADD(&driver_data->sync_polled, 1);
+    for (n = 0;; n++) {
+        delay_usec(delay);
+        if (n >= VDPAU_SYNC_SPIN_COUNT)
+            delay = MIN(2 * delay, VDPAU_SYNC_DELAY);
 
-        if (va_surface_status != VASurfaceDisplaying)
+        va_status = query_surface_status(driver_data, obj_surface, NULL);
+        if (va_status != VA_STATUS_SUCCESS)
+            return va_status;
+        if (!(obj_surface->pending & SURFACE_PENDING_PRESENT))
             break;
-        delay_usec(VDPAU_SYNC_DELAY);
     }
     return VA_STATUS_SUCCESS;
 }
 
+// Wait for the surface to complete pending operations
+VAStatus
+sync_surface(
+    vdpau_driver_data_t *driver_data,
+    object_surface_p     obj_surface
+)
+{
+    uint64_t start_ticks = 0;
+    VAStatus va_status;
+
+    if (stats_enabled())
+        start_ticks = get_ticks_usec();
+
+    va_status = async_decode_sync(driver_data, obj_surface);
+    if (va_status == VA_STATUS_SUCCESS)
+        va_status = sync_surface_present(driver_data, obj_surface);
+
+    if (stats_enabled())
+        sync_surface_record_latency(driver_data, get_ticks_usec() - start_ticks);
+    return va_status;
+}
+
 // vaSyncSurface
 VAStatus
 vdpau_SyncSurface2(
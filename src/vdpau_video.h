@@ -23,6 +23,8 @@
 
 #include "vdpau_driver.h"
 #include "vdpau_decode.h"
+#include "uasyncqueue.h"
+#include <pthread.h>
 
 typedef struct SubpictureAssociation *SubpictureAssociationP;
 struct SubpictureAssociation {
@@ -42,6 +44,33 @@ struct object_config {
     int                          attrib_count;
 };
 
+typedef union vdp_picture_info vdp_picture_info_t;
+union vdp_picture_info {
+    VdpPictureInfoMPEG1Or2       mpeg2;
+#if HAVE_VDPAU_MPEG4
+    VdpPictureInfoMPEG4Part2     mpeg4;
+#endif
+    VdpPictureInfoH264           h264;
+    VdpPictureInfoVC1            vc1;
+};
+
+/* Last IQ matrix translated into vdp_picture_info */
+typedef union va_iq_matrix va_iq_matrix_t;
+union va_iq_matrix {
+    VAIQMatrixBufferMPEG2        mpeg2;
+#if USE_VDPAU_MPEG4
+    VAIQMatrixBufferMPEG4        mpeg4;
+#endif
+    VAIQMatrixBufferH264         h264;
+};
+
+/* Maps a render target to its VDPAU surface */
+typedef struct vdpau_surface_map_entry vdpau_surface_map_entry_t;
+struct vdpau_surface_map_entry {
+    VASurfaceID                  va_surface;
+    VdpVideoSurface              vdp_surface;
+};
+
 typedef struct object_context object_context_t;
 struct object_context {
     struct object_base           base;
@@ -53,30 +82,59 @@ struct object_context {
     int                          num_render_targets;
     int                          flags;
     int                          max_ref_frames;
+    int                          dpb_max_ref_frames;
     VASurfaceID                 *render_targets;
+    vdpau_surface_map_entry_t   *surface_map;
+    unsigned int                 surface_map_mask;
     VABufferID                  *dead_buffers;
     uint32_t                     dead_buffers_count;
     uint32_t                     dead_buffers_count_max;
+    object_buffer_p             *recycled_buffers;
+    unsigned int                 recycled_buffers_count;
+    unsigned int                 recycled_buffers_count_max;
+    object_buffer_p             *render_buffers;
+    unsigned int                 render_buffers_count_max;
     void                        *last_pic_param;
     void                        *last_slice_params;
     unsigned int                 last_slice_params_count;
+    unsigned int                 picture_is_intra;
+    VdpDecodePolicy              decode_policy;
+    unsigned int                 decode_policy_n;
+    unsigned int                 decode_policy_count;
     VdpCodec                     vdp_codec;
+    const vdpau_codec_ops_t     *codec_ops;
     VdpDecoderProfile            vdp_profile;
     VdpDecoder                   vdp_decoder;
+    vdpau_sched_session_t        sched_session;
     uint8_t                     *gen_slice_data;
     unsigned int                 gen_slice_data_size;
     unsigned int                 gen_slice_data_size_max;
     VdpBitstreamBuffer          *vdp_bitstream_buffers;
     unsigned int                 vdp_bitstream_buffers_count;
     unsigned int                 vdp_bitstream_buffers_count_max;
-    union {
-        VdpPictureInfoMPEG1Or2   mpeg2;
-#if HAVE_VDPAU_MPEG4
-        VdpPictureInfoMPEG4Part2 mpeg4;
-#endif
-        VdpPictureInfoH264       h264;
-        VdpPictureInfoVC1        vc1;
-    }                            vdp_picture_info;
+    uint8_t                     *bitstream_arena;
+    unsigned int                 bitstream_arena_size;
+    unsigned int                 bitstream_arena_size_max;
+    unsigned int                 bitstream_arena_peaks[VDPAU_BITSTREAM_ARENA_HISTORY];
+    unsigned int                 bitstream_arena_frame;
+    vdp_picture_info_t           vdp_picture_info;
+    va_iq_matrix_t               last_iq_matrix;
+    unsigned int                 last_iq_matrix_size;
+    uint32_t                     last_seq_fields;
+    unsigned int                 last_seq_fields_valid;
+    UAsyncQueue                 *async_queue;
+    pthread_t                    async_thread;
+    pthread_mutex_t              async_lock;
+    pthread_cond_t               async_cond;
+    uint64_t                     async_submitted;
+    uint64_t                     async_completed;
+};
+
+// Outstanding operations on a surface
+enum {
+    SURFACE_PENDING_DECODE      = 1 << 0, /* vaBeginPicture() .. decoder submission */
+    SURFACE_PENDING_MIX         = 1 << 1, /* mixed into an output surface not flipped yet */
+    SURFACE_PENDING_PRESENT     = 1 << 2  /* output surface queued for display */
 };
 
 typedef struct object_surface object_surface_t;
@@ -95,6 +153,14 @@ struct object_surface {
     SubpictureAssociationP      *assocs;
     unsigned int                 assocs_count;
     unsigned int                 assocs_count_max;
+    unsigned int                 pending;
+    unsigned int                 is_skipped;
+    uint64_t                     decode_seq;
+    VdpStatus                    decode_status;
+    int                          mix_output;
+    unsigned int                 mix_seq;
+    int                          present_output;
+    unsigned int                 present_seq;
 };
 
 // Query surface status
@@ -105,6 +171,18 @@ query_surface_status(
     VASurfaceStatus     *status
 ) attribute_hidden;
 
+// Destroys the context, including any decode still queued for it
+void
+destroy_context(
+    vdpau_driver_data_t *driver_data,
+    object_context_p     obj_context
+) attribute_hidden;
+
+// Dump vaSyncSurface() latency histogram
+void
+sync_surface_dump_statistics(vdpau_driver_data_t *driver_data)
+    attribute_hidden;
+
 // Wait for the surface to complete pending operations
 VAStatus
 sync_surface(
@@ -343,7 +343,9 @@ output_surface_ensure(
     /* ... that might have been created for another video surface */
     if (!obj_output) {
         object_heap_iterator iter;
-        object_base_p obj = object_heap_first(&driver_data->output_heap, &iter);
+        object_base_p obj;
+        object_heap_lock(&driver_data->output_heap);
+        obj = object_heap_first_unlocked(&driver_data->output_heap, &iter);
         while (obj) {
             object_output_p m = (object_output_p)obj;
             if (m->drawable == drawable) {
@@ -351,8 +353,9 @@ output_surface_ensure(
                 new_obj_output = 1;
                 break;
             }
-            obj = object_heap_next(&driver_data->output_heap, &iter);
+            obj = object_heap_next_unlocked(&driver_data->output_heap, &iter);
         }
+        object_heap_unlock(&driver_data->output_heap);
     }
 
     /* Fallback: create a new output surface */
@@ -396,6 +399,11 @@ render_surface(
     unsigned int         flags
 )
 {
+    VAStatus va_status;
+    va_status = async_decode_sync(driver_data, obj_surface);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
     VdpRect src_rect;
     src_rect.x0 = source_rect->x;
     src_rect.y0 = source_rect->y;
@@ -604,7 +612,6 @@ queue_surface_unlocked(
     object_output_p      obj_output
 )
 {
-    obj_surface->va_surface_status       = VASurfaceDisplaying;
     obj_output->fields                   = 0;
 
     return flip_surface_unlocked(driver_data, obj_output);
@@ -639,8 +646,6 @@ put_surface_unlocked(
     VdpStatus vdp_status;
     VAStatus va_status;
 
-    obj_surface->va_surface_status = VASurfaceReady;
-
     /* Wait for the output surface to be ready.
        i.e. it completed the previous rendering */
     if (obj_output->vdp_output_surfaces[obj_output->current_output_surface] != VDP_INVALID_HANDLE &&
@@ -668,6 +673,12 @@ put_surface_unlocked(
     if (va_status != VA_STATUS_SUCCESS)
         return va_status;
 
+    /* The surface is displaying from now on, until the output surface
+       it was mixed into leaves the presentation queue */
+    obj_surface->pending   |= SURFACE_PENDING_MIX;
+    obj_surface->mix_output = obj_output->base.id;
+    obj_surface->mix_seq    = obj_output->queued_surfaces;
+
     /* Render subpictures to the output surface, applying scaling */
     va_status = render_subpictures(
         driver_data,